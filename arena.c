@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "arena.h"
+
+
+#define ARENA_CHUNK_SIZE 8192	/* default chunk payload */
+#define ARENA_ALIGN _Alignof(max_align_t)	/* alignment of every allocation; data[] starts aligned too */
+
+
+
+/**
+ * Initializes an empty arena.
+ *
+ * @param arena the arena to initialize.  Should be non-NULL.
+ */
+void init_arena( ARENA *arena )
+{
+  assert( arena != NULL );
+  arena->head = NULL;
+  arena->current = NULL;
+}
+
+
+
+/* mallocs a chunk with room for at least size bytes */
+static ARENA_CHUNK *new_chunk( size_t size )
+{
+  ARENA_CHUNK *chunk;
+
+  if( size < ARENA_CHUNK_SIZE )
+    size = ARENA_CHUNK_SIZE;
+  chunk = (ARENA_CHUNK *)malloc( sizeof(ARENA_CHUNK) + size );
+  assert( chunk != NULL );
+  chunk->next = NULL;
+  chunk->size = size;
+  chunk->used = 0;
+  return chunk;
+}
+
+
+
+/**
+ * Allocates memory from the arena.
+ *
+ * @param arena an initialized arena
+ * @param size number of bytes wanted
+ * @return the allocated memory; never NULL
+ */
+void *arena_alloc( ARENA *arena, size_t size )
+{
+  ARENA_CHUNK *chunk = arena->current;
+  void *mem;
+
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+  if( chunk == NULL ) {		/* first allocation */
+    chunk = arena->head = arena->current = new_chunk( size );
+  }
+
+  while( chunk->size - chunk->used < size ) {
+    /* reuse the chunks left over from before the last reset, but
+     * splice in a fresh one if the next is too small */
+    if( chunk->next == NULL || chunk->next->size < size ) {
+      ARENA_CHUNK *fresh = new_chunk( size );
+      fresh->next = chunk->next;
+      chunk->next = fresh;
+    }
+    chunk = chunk->next;
+    chunk->used = 0;
+    arena->current = chunk;
+  }
+
+  mem = chunk->data + chunk->used;
+  chunk->used += size;
+  return mem;
+}
+
+
+
+/**
+ * Copies length bytes of a string into the arena and null-terminates
+ * the copy.
+ *
+ * @param arena an initialized arena
+ * @param string the bytes to copy
+ * @param length number of bytes to copy
+ * @return the null-terminated copy
+ */
+char *arena_strndup( ARENA *arena, const char *string, size_t length )
+{
+  char *copy = (char *)arena_alloc( arena, length + 1 );
+  memcpy( copy, string, length );
+  copy[length] = '\0';
+  return copy;
+}
+
+
+
+/**
+ * Releases everything allocated from the arena in constant time.
+ * @param arena an initialized arena
+ */
+void arena_reset( ARENA *arena )
+{
+  assert( arena != NULL );
+  if( arena->head != NULL ) {
+    arena->head->used = 0;
+    arena->current = arena->head;
+  }
+}
+
+
+
+/**
+ * Returns all of the arena's chunks to malloc.
+ * @param arena an initialized arena
+ */
+void free_arena( ARENA *arena )
+{
+  ARENA_CHUNK *chunk, *next;
+
+  assert( arena != NULL );
+  for( chunk = arena->head; chunk != NULL; chunk = next ) {
+    next = chunk->next;
+    free( chunk );
+  }
+  arena->head = NULL;
+  arena->current = NULL;
+}
@@ -0,0 +1,85 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+
+#include <stddef.h>
+
+
+
+/**
+ * One block of arena memory.  Chunks are kept in a list and reused
+ * after a reset rather than handed back to malloc.
+ */
+typedef struct arena_chunk {
+  struct arena_chunk *next;	/* next chunk in the list */
+  size_t size;			/* bytes available in data */
+  size_t used;			/* bytes handed out from data */
+  _Alignas(max_align_t) char data[];	/* aligned for any type */
+} ARENA_CHUNK;
+
+
+
+/**
+ * Control structure for a bump allocator.  Everything allocated from
+ * an arena is released at once by arena_reset or free_arena.
+ */
+typedef struct arena {
+  ARENA_CHUNK *head;		/* first chunk, NULL until first use */
+  ARENA_CHUNK *current;		/* chunk allocations come from */
+} ARENA;
+
+
+
+/**
+ * Initializes an empty arena.  Nothing is allocated until the first
+ * call to arena_alloc.
+ *
+ * @param arena the arena to initialize.  Should be non-NULL.
+ */
+void init_arena( ARENA *arena );
+
+
+
+/**
+ * Allocates memory from the arena.  The memory is suitably aligned
+ * for any type and lives until the arena is reset or freed.
+ *
+ * @param arena an initialized arena
+ * @param size number of bytes wanted
+ * @return the allocated memory; never NULL
+ */
+void *arena_alloc( ARENA *arena, size_t size );
+
+
+
+/**
+ * Copies length bytes of a string into the arena and null-terminates
+ * the copy.
+ *
+ * @param arena an initialized arena
+ * @param string the bytes to copy
+ * @param length number of bytes to copy
+ * @return the null-terminated copy
+ */
+char *arena_strndup( ARENA *arena, const char *string, size_t length );
+
+
+
+/**
+ * Releases everything allocated from the arena in constant time.
+ * The arena's chunks are kept for reuse.
+ *
+ * @param arena an initialized arena
+ */
+void arena_reset( ARENA *arena );
+
+
+
+/**
+ * Returns all of the arena's chunks to malloc.
+ * @param arena an initialized arena
+ */
+void free_arena( ARENA *arena );
+
+
+#endif
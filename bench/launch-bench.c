@@ -0,0 +1,115 @@
+/* End-to-end benchmark for launching commands through the shell.
+ *
+ * Writes a script that repeats one command line many times, runs it
+ * with "penn-shredder -f" under every launch mode and prints one line
+ * per (case, mode) pair:
+ *
+ *     launch/<case>/<mode>\t<commands/s>\t<us/command>
+ *
+ * The best of several runs is reported, so a noisy neighbour makes a
+ * result slower only if it lasts the whole measurement. The shell's
+ * own startup is included, but is amortized over every line.
+ *
+ * usage: launch-bench [shell [lines]] */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define DEFAULT_LINES 2000      //command lines per script
+#define RUNS 3                  //the fastest run is reported
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Writes a script repeating line and returns its path */
+static char *write_script(const char *line, int lines)
+{
+    static char path[] = "/tmp/penn-bench-XXXXXX";
+    FILE *script;
+    int fd, i;
+
+    strcpy(path + strlen(path) - 6, "XXXXXX");
+    if ((fd = mkstemp(path)) < 0 || (script = fdopen(fd, "w")) == NULL) {
+        perror("launch-bench: script");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < lines; i++)
+        fprintf(script, "%s\n", line);
+    fclose(script);
+    return path;
+}
+
+/* Runs the script once; returns seconds, or -1 if the shell failed */
+static double run(const char *shell, const char *script, const char *mode)
+{
+    double start = now();
+    int status;
+    pid_t pid = fork();
+
+    if (pid < 0) {
+        perror("launch-bench: fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        setenv("PENN_LAUNCH", mode, 1);
+        execl(shell, shell, "-f", script, (char *)NULL);
+        perror(shell);
+        _exit(127);
+    }
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return -1;
+    return now() - start;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct { const char *name; const char *line; } cases[] = {
+        { "true",      "/bin/true" },          //a path, so the true builtin is not used
+        { "true-pipe", "/bin/true | /bin/true" },
+        { "redirect",  "/bin/true < /dev/null > /dev/null" },
+        { "builtin",   "echo x > /dev/null" },
+    };
+    static const char *modes[] = { "fork", "spawn", "zygote" };
+    const char *shell = argc > 1 ? argv[1] : "./penn-shredder";
+    int lines = argc > 2 ? atoi(argv[2]) : DEFAULT_LINES;
+    size_t c, m;
+    int r;
+
+    if (lines <= 0) {
+        fprintf(stderr, "usage: launch-bench [shell [lines]]\n");
+        return EXIT_FAILURE;
+    }
+
+    for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        char *script = write_script(cases[c].line, lines);
+
+        for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+            double best = -1;
+
+            for (r = 0; r < RUNS; r++) {
+                double secs = run(shell, script, modes[m]);
+
+                if (secs < 0) {
+                    fprintf(stderr, "launch/%s/%s: shell failed\n", cases[c].name, modes[m]);
+                    unlink(script);
+                    return EXIT_FAILURE;
+                }
+                if (best < 0 || secs < best)
+                    best = secs;
+            }
+            printf("launch/%s/%s\t%.1f\t%.2f\n", cases[c].name, modes[m],
+                   lines / best, best * 1e6 / lines);
+            fflush(stdout);
+        }
+        unlink(script);
+    }
+    return 0;
+}
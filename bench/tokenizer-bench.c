@@ -0,0 +1,189 @@
+/* Micro-benchmark for the tokenizer's word scanners.
+ *
+ * Tokenizes synthetic command lines with every scanner the CPU
+ * supports, plus a copy of the original byte-at-a-time loop from
+ * get_next_token as the baseline and the malloc-per-token
+ * get_next_token wrapper itself, and prints one line per
+ * (case, scanner) pair:
+ *
+ *     tokenizer/<case>/<scanner>\t<MB/s>\t<ns/token>
+ *
+ * Every scanner's spans are checked against the baseline first, so
+ * a wrong answer fails the run rather than looking fast. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "../tokenizer.h"
+
+#define TARGET_BYTES (256u << 20)   //bytes to tokenize per measurement
+
+/* The original get_next_token word loop, minus the malloc, so the
+ * comparison is of the scan alone. */
+static int legacy_next_span(TOKENIZER *tokenizer, TOKEN_SPAN *span)
+{
+    char *startptr = tokenizer->pos;
+    char *endptr;
+
+    while (isspace(*startptr))
+        startptr++;
+    if (*startptr == '\0')
+        return 0;
+    if ((*startptr == '|') || (*startptr == '&') ||
+        (*startptr == '<') || (*startptr == '>')) {
+        span->offset = startptr - tokenizer->str;
+        span->length = 1;
+        tokenizer->pos = startptr + 1;
+        return 1;
+    }
+    endptr = startptr;
+    for (;;) {
+        if ((*(endptr+1) == '|') || (*(endptr+1) == '&') || (*(endptr+1) == '<') ||
+            (*(endptr+1) == '>') || (*(endptr+1) == '\0') || (isspace(*(endptr+1)))) {
+            span->offset = startptr - tokenizer->str;
+            span->length = (endptr - startptr) + 1;
+            tokenizer->pos = endptr + 1;
+            return 1;
+        }
+        endptr++;
+    }
+}
+
+/* Builds a line of roughly size bytes by repeating a word pattern */
+static char *make_line(const char *pattern, size_t size)
+{
+    size_t plen = strlen(pattern);
+    char *line = malloc(size + plen + 1);
+    size_t len = 0;
+
+    while (len < size) {
+        memcpy(line + len, pattern, plen);
+        len += plen;
+    }
+    line[len] = '\0';
+    return line;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Tokenizes line repeatedly; returns seconds and sets *tokens */
+static double run(char *line, int legacy, size_t reps, size_t *tokens)
+{
+    TOKENIZER tokenizer;
+    TOKEN_SPAN span;
+    size_t count = 0, sink = 0, i;
+    double start = now();
+
+    for (i = 0; i < reps; i++) {
+        init_span_tokenizer(&tokenizer, line);
+        if (legacy) {
+            while (legacy_next_span(&tokenizer, &span)) {
+                count++;
+                sink += span.length;
+            }
+        } else {
+            while (get_next_span(&tokenizer, &span)) {
+                count++;
+                sink += span.length;
+            }
+        }
+    }
+    *tokens = count;
+    __asm__ volatile("" : : "r"(sink));
+    return now() - start;
+}
+
+/* Tokenizes line repeatedly through get_next_token, which copies
+ * every token into its own malloc'd string */
+static double run_tokens(char *line, size_t reps, size_t *tokens)
+{
+    TOKENIZER *tokenizer;
+    char *token;
+    size_t count = 0, sink = 0, i;
+    double start = now();
+
+    for (i = 0; i < reps; i++) {
+        tokenizer = init_tokenizer(line);
+        while ((token = get_next_token(tokenizer)) != NULL) {
+            count++;
+            sink += token[0];
+            free(token);
+        }
+        free_tokenizer(tokenizer);
+    }
+    *tokens = count;
+    __asm__ volatile("" : : "r"(sink));
+    return now() - start;
+}
+
+/* Checks the current scanner against the legacy loop */
+static int matches_legacy(char *line)
+{
+    TOKENIZER a, b;
+    TOKEN_SPAN sa, sb;
+    int ra, rb;
+
+    init_span_tokenizer(&a, line);
+    init_span_tokenizer(&b, line);
+    do {
+        ra = legacy_next_span(&a, &sa);
+        rb = get_next_span(&b, &sb);
+        if (ra != rb || (ra && (sa.offset != sb.offset || sa.length != sb.length)))
+            return 0;
+    } while (ra);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct { const char *name; const char *pattern; size_t size; } cases[] = {
+        { "short",            "ls -l /tmp ",                                      11 },
+        { "long",             "/var/log/build/artifacts/2024/obj/module_unit_test_object_file.o ", 1 << 20 },
+        { "delimiter-dense",  "a|b<c>d&",                                         1 << 20 },
+        { "whitespace-heavy", "x \t  \t  ",                                       1 << 20 },
+    };
+    static const char *scanners[] = { "scalar", "sse2", "avx2" };
+    size_t c, s;
+
+    (void)argc;
+    (void)argv;
+
+    for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        char *line = make_line(cases[c].pattern, cases[c].size);
+        size_t len = strlen(line);
+        size_t reps = TARGET_BYTES / len / 8 + 1;
+        size_t tokens;
+        double secs;
+
+        secs = run(line, 1, reps, &tokens);
+        printf("tokenizer/%s/legacy\t%.1f\t%.2f\n", cases[c].name,
+               len * (double)reps / secs / 1e6, secs * 1e9 / tokens);
+
+        for (s = 0; s < sizeof(scanners) / sizeof(scanners[0]); s++) {
+            if (!set_tokenizer_scanner(scanners[s]))
+                continue;
+            if (!matches_legacy(line)) {
+                fprintf(stderr, "tokenizer/%s/%s: spans differ from legacy loop\n",
+                        cases[c].name, scanners[s]);
+                return EXIT_FAILURE;
+            }
+            secs = run(line, 0, reps, &tokens);
+            printf("tokenizer/%s/%s\t%.1f\t%.2f\n", cases[c].name, scanners[s],
+                   len * (double)reps / secs / 1e6, secs * 1e9 / tokens);
+        }
+
+        set_tokenizer_scanner("auto");
+        reps = reps / 4 + 1;                    //a malloc per token is far slower
+        secs = run_tokens(line, reps, &tokens);
+        printf("tokenizer/%s/get_next_token\t%.1f\t%.2f\n", cases[c].name,
+               len * (double)reps / secs / 1e6, secs * 1e9 / tokens);
+        free(line);
+    }
+    return 0;
+}
@@ -0,0 +1,509 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include "builtins.h"
+#include "pathcache.h"
+#include "parsecache.h"
+#include "history.h"
+#include "jobs.h"
+#include "parallel.h"
+#include "copy.h"
+#include "launch.h"
+#include "zygote.h"
+#include "stats.h"
+
+extern char **environ;
+
+/* cd [dir | -]: changes the shell's working directory, keeping
+ * PWD and OLDPWD up to date. Without an argument goes to $HOME */
+static int builtinCd(int argc, char **argv)
+{
+    const char *dir = argc > 1 ? argv[1] : getenv("HOME");
+    char *cwd;
+
+    if (argc > 2)
+    {
+        dprintf(STDERR_FILENO, "cd: too many arguments\n");
+        return 1;
+    }
+    if (dir != NULL && !strcmp(dir, "-"))
+    {
+        dir = getenv("OLDPWD");
+        if (dir == NULL)
+        {
+            dprintf(STDERR_FILENO, "cd: OLDPWD not set\n");
+            return 1;
+        }
+        dprintf(STDOUT_FILENO, "%s\n", dir);
+    }
+    if (dir == NULL)
+    {
+        dprintf(STDERR_FILENO, "cd: HOME not set\n");
+        return 1;
+    }
+
+    cwd = getcwd(NULL, 0);
+    if (chdir(dir) == -1)
+    {
+        dprintf(STDERR_FILENO, "cd: %s: %s\n", dir, strerror(errno));
+        free(cwd);
+        return 1;
+    }
+    zygote_environment_changed();                           //the launcher helper follows the shell's cwd
+    if (cwd != NULL)
+    {
+        setenv("OLDPWD", cwd, 1);
+        free(cwd);
+    }
+    if ((cwd = getcwd(NULL, 0)) != NULL)
+    {
+        setenv("PWD", cwd, 1);
+        free(cwd);
+    }
+    return 0;
+}
+
+/* exit [n]: leaves the shell with status n, or the last command's */
+static int builtinExit(int argc, char **argv)
+{
+    exit(argc > 1 ? atoi(argv[1]) & 0xff : lastStatus);
+}
+
+/* echo [-n] [arg ...]: writes its arguments separated by spaces */
+static int builtinEcho(int argc, char **argv)
+{
+    int newline = 1;
+    int i = 1;
+    size_t len = 0;
+    char *line, *end;
+
+    if (argc > 1 && !strcmp(argv[1], "-n"))
+    {
+        newline = 0;
+        i++;
+    }
+    for (int j = i; j < argc; j++)
+    {
+        len += strlen(argv[j]) + 1;
+    }
+    if ((line = malloc(len + 1)) == NULL)
+    {
+        return 1;
+    }
+    end = line;
+    for (; i < argc; i++)                                   //one write for the whole line
+    {
+        end = stpcpy(end, argv[i]);
+        if (i < argc - 1)
+        {
+            *end++ = ' ';
+        }
+    }
+    if (newline)
+    {
+        *end++ = '\n';
+    }
+    if (end > line && write(STDOUT_FILENO, line, end - line) == -1)
+    {
+        free(line);
+        return 1;
+    }
+    free(line);
+    return 0;
+}
+
+static int builtinTrue(int argc, char **argv)
+{
+    return 0;
+}
+
+static int builtinFalse(int argc, char **argv)
+{
+    return 1;
+}
+
+/* pwd: prints the working directory */
+static int builtinPwd(int argc, char **argv)
+{
+    char *cwd = getcwd(NULL, 0);
+
+    if (cwd == NULL)
+    {
+        dprintf(STDERR_FILENO, "pwd: %s\n", strerror(errno));
+        return 1;
+    }
+    dprintf(STDOUT_FILENO, "%s\n", cwd);
+    free(cwd);
+    return 0;
+}
+
+/* export [name=value ...]: sets environment variables for the shell
+ * and everything it launches. Without arguments lists them */
+static int builtinExport(int argc, char **argv)
+{
+    int status = 0;
+    int i;
+
+    if (argc == 1)
+    {
+        for (char **env = environ; *env != NULL; env++)
+        {
+            dprintf(STDOUT_FILENO, "export %s\n", *env);
+        }
+        return 0;
+    }
+    for (i = 1; i < argc; i++)
+    {
+        char *eq = strchr(argv[i], '=');
+        char *name;
+
+        if (eq == NULL)
+        {
+            continue;                                       //everything in the environment is already exported
+        }
+        name = strndup(argv[i], eq - argv[i]);
+        if (name == NULL || *name == '\0' || setenv(name, eq + 1, 1) == -1)
+        {
+            dprintf(STDERR_FILENO, "export: `%s': not a valid identifier\n", argv[i]);
+            status = 1;
+        }
+        free(name);
+    }
+    zygote_environment_changed();
+    return status;
+}
+
+/* hash [-r]: lists the remembered command paths, or forgets them */
+static int builtinHash(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "-r"))
+    {
+        pathcache_clear();
+    }
+    else
+    {
+        pathcache_print(STDOUT_FILENO);
+    }
+    return 0;
+}
+
+/* parsecache [-r]: shows how often a line was parsed from the cache,
+ * or empties it */
+static int builtinParseCache(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "-r"))
+    {
+        parsecache_clear();
+    }
+    else
+    {
+        parsecache_print(STDOUT_FILENO);
+    }
+    return 0;
+}
+
+/* history [n]: lists the last n commands, or all of them */
+static int builtinHistory(int argc, char **argv)
+{
+    char *end;
+    long count = 0;
+
+    if (argc > 1)
+    {
+        count = strtol(argv[1], &end, 10);
+        if (end == argv[1] || *end != '\0' || count < 0)
+        {
+            dprintf(STDERR_FILENO, "history: %s: numeric argument required\n", argv[1]);
+            return 1;
+        }
+    }
+    history_print(STDOUT_FILENO, count);
+    return 0;
+}
+
+/* Resolves a job argument: %n for job n, %+ or %% for the current
+ * job, or the pid of one of a job's processes */
+static JOB *jobFromArgument(const char *name, const char *arg)
+{
+    JOB *job;
+
+    if (!strcmp(arg, "%+") || !strcmp(arg, "%%"))
+    {
+        job = current_job();
+    }
+    else if (arg[0] == '%')
+    {
+        job = find_job(atoi(arg + 1));
+    }
+    else
+    {
+        job = find_job_by_pid(atoi(arg));
+    }
+    if (job == NULL)
+    {
+        dprintf(STDERR_FILENO, "%s: %s: no such job\n", name, arg);
+    }
+    return job;
+}
+
+/* jobs: lists background jobs */
+static int builtinJobs(int argc, char **argv)
+{
+    print_jobs(STDOUT_FILENO);
+    return 0;
+}
+
+/* wait [job ...]: waits for the given jobs, or every running
+ * background job, and returns the status of the last one waited
+ * for. Stopped jobs are skipped, as they may never finish. ^C stops
+ * waiting and leaves the jobs running */
+static int builtinWait(int argc, char **argv)
+{
+    JOB *job;
+    int status = 0;
+    int i;
+
+    if (argc == 1)
+    {
+        while (!interrupted && (job = running_job()) != NULL)
+        {
+            status = wait_job(job);
+        }
+        return status;
+    }
+    for (i = 1; i < argc && !interrupted; i++)
+    {
+        if ((job = jobFromArgument("wait", argv[i])) == NULL)
+        {
+            status = 127;
+            continue;
+        }
+        status = wait_job(job);
+    }
+    return status;
+}
+
+/* fg [job]: brings a background or stopped job, by default the
+ * current one, back into the foreground and waits for it */
+static int builtinFg(int argc, char **argv)
+{
+    JOB *job = argc > 1 ? jobFromArgument("fg", argv[1]) : current_job();
+
+    if (job == NULL)
+    {
+        if (argc == 1)
+        {
+            dprintf(STDERR_FILENO, "fg: current: no such job\n");
+        }
+        return 1;
+    }
+    dprintf(STDOUT_FILENO, "%s\n", job->text);
+    continue_job(job, 0);
+    return wait_job(job);
+}
+
+/* bg [job]: lets a stopped job, by default the current one, carry
+ * on in the background */
+static int builtinBg(int argc, char **argv)
+{
+    JOB *job = argc > 1 ? jobFromArgument("bg", argv[1]) : current_job();
+
+    if (job == NULL)
+    {
+        if (argc == 1)
+        {
+            dprintf(STDERR_FILENO, "bg: current: no such job\n");
+        }
+        return 1;
+    }
+    continue_job(job, 1);
+    dprintf(STDOUT_FILENO, "[%d]+ %s &\n", job->id, job->text);
+    return 0;
+}
+
+/* cat [file ...]: copies the files, or standard input, to standard
+ * output without the bytes passing through user space when the
+ * kernel can move them itself (see copy_fd) */
+static int builtinCat(int argc, char **argv)
+{
+    int status = 0;
+    int i;
+
+    if (argc == 1)
+    {
+        return copy_fd(STDIN_FILENO, STDOUT_FILENO) < 0 ? 1 : 0;
+    }
+    for (i = 1; i < argc; i++)
+    {
+        int fd = strcmp(argv[i], "-") ? open(argv[i], O_RDONLY | O_CLOEXEC) : STDIN_FILENO;
+
+        if (fd < 0 || copy_fd(fd, STDOUT_FILENO) < 0)
+        {
+            dprintf(STDERR_FILENO, "cat: %s: %s\n", argv[i], strerror(errno));
+            status = 1;
+        }
+        if (fd > STDIN_FILENO)
+        {
+            close(fd);
+        }
+    }
+    return status;
+}
+
+/* Options such as cat -n are left to the real cat */
+static int catAccepts(int argc, char **argv)
+{
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (argv[i][0] == '-' && argv[i][1] != '\0')
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Parses a size such as 4096, 64k or 1m; returns -1 if malformed */
+static long parseSize(const char *text)
+{
+    char *end;
+    long size = strtol(text, &end, 10);
+
+    if (end == text || size < 0)
+    {
+        return -1;
+    }
+    if (*end == 'k' || *end == 'K')
+    {
+        size <<= 10;
+        end++;
+    }
+    else if (*end == 'm' || *end == 'M')
+    {
+        size <<= 20;
+        end++;
+    }
+    return *end == '\0' ? size : -1;
+}
+
+/* set [option [value]]: shows or changes shell options.
+ *   launch fork|spawn|zygote     how pipeline stages are started
+ *   pipesize N[k|m]      pipe buffer size between stages, 0 for the default
+ *   statslog path|off    append a JSON line per finished command to path
+ *   timeout seconds      kill jobs that run longer, 0 for no limit */
+static int builtinSet(int argc, char **argv)
+{
+    long size;
+
+    if (argc == 1 || (argc == 2 && !strcmp(argv[1], "launch")))
+    {
+        dprintf(STDOUT_FILENO, "launch\t%s\n", get_launch_mode());
+    }
+    if (argc == 1 || (argc == 2 && !strcmp(argv[1], "pipesize")))
+    {
+        dprintf(STDOUT_FILENO, "pipesize\t%ld (effective %ld)\n",
+                get_pipe_size(), get_effective_pipe_size());
+    }
+    if (argc == 1 || (argc == 2 && !strcmp(argv[1], "statslog")))
+    {
+        dprintf(STDOUT_FILENO, "statslog\t%s\n", get_stats_log() != NULL ? get_stats_log() : "off");
+    }
+    if (argc == 1 || (argc == 2 && !strcmp(argv[1], "timeout")))
+    {
+        dprintf(STDOUT_FILENO, "timeout\t%g\n", get_job_timeout());
+    }
+    if (argc <= 2)
+    {
+        return 0;
+    }
+
+    if (!strcmp(argv[1], "launch"))
+    {
+        if (!set_launch_mode(argv[2]))
+        {
+            dprintf(STDERR_FILENO, "set: launch: expected fork, spawn or zygote\n");
+            return 1;
+        }
+        return 0;
+    }
+    if (!strcmp(argv[1], "pipesize"))
+    {
+        if ((size = parseSize(argv[2])) < 0)
+        {
+            dprintf(STDERR_FILENO, "set: pipesize: invalid size `%s'\n", argv[2]);
+            return 1;
+        }
+        size = set_pipe_size(size);
+        dprintf(STDOUT_FILENO, "pipesize\t%ld (effective %ld)\n", size, get_effective_pipe_size());
+        return 0;
+    }
+    if (!strcmp(argv[1], "statslog"))
+    {
+        if (set_stats_log(argv[2]) < 0)
+        {
+            dprintf(STDERR_FILENO, "set: statslog: %s: %s\n", argv[2], strerror(errno));
+            return 1;
+        }
+        return 0;
+    }
+    if (!strcmp(argv[1], "timeout"))
+    {
+        char *end;
+        double seconds = strtod(argv[2], &end);
+
+        if (end == argv[2] || *end != '\0' || seconds < 0)
+        {
+            dprintf(STDERR_FILENO, "set: timeout: invalid time `%s'\n", argv[2]);
+            return 1;
+        }
+        set_job_timeout(seconds);
+        return 0;
+    }
+    dprintf(STDERR_FILENO, "set: %s: unknown option\n", argv[1]);
+    return 1;
+}
+
+static const BUILTIN builtins[] = {
+    { "cd",     builtinCd },
+    { "exit",   builtinExit },
+    { "echo",   builtinEcho },
+    { "true",   builtinTrue },
+    { "false",  builtinFalse },
+    { "pwd",    builtinPwd },
+    { "export", builtinExport },
+    { "hash",   builtinHash },
+    { "parsecache", builtinParseCache },
+    { "history", builtinHistory },
+    { "jobs",   builtinJobs },
+    { "wait",   builtinWait },
+    { "fg",     builtinFg },
+    { "bg",     builtinBg },
+    { "parallel", run_parallel },
+    { "cat",    builtinCat, catAccepts, 1 },       //may copy without end, so it gets a process of its own
+    { "set",    builtinSet },
+};
+
+/* Finds the builtin that handles a command, or returns NULL */
+const BUILTIN *find_builtin(int argc, char **argv)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++)
+    {
+        if (!strcmp(builtins[i].name, argv[0]))
+        {
+            if (builtins[i].accepts != NULL && !builtins[i].accepts(argc, argv))
+            {
+                return NULL;
+            }
+            return &builtins[i];
+        }
+    }
+    return NULL;
+}
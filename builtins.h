@@ -0,0 +1,54 @@
+#ifndef __BUILTINS_H__
+#define __BUILTINS_H__
+
+
+#include "reader.h"
+
+
+
+/**
+ * A command the shell runs itself instead of launching a program.
+ * It writes to descriptors 0, 1 and 2 directly, so the shell's
+ * redirections apply to it like to any other command.
+ */
+typedef struct builtin {
+  const char *name;		/* command name */
+  int (*run)( int argc, char **argv );	/* returns the exit status */
+  int (*accepts)( int argc, char **argv ); /* NULL, or 0 to leave these
+					    arguments to the program
+					    of the same name */
+  int job;			/* 1 to always run it as a job of its own, so
+				   ^C and timeouts reach it */
+} BUILTIN;
+
+
+
+/**
+ * Exit status of the last command, maintained by the shell.
+ */
+extern int lastStatus;
+
+
+
+/**
+ * The shell's buffered reader over its standard input, or NULL when
+ * standard input is not the shell's: when the shell runs a script,
+ * while a builtin's input is redirected, and in a forked builtin.
+ * Builtins that read standard input read through it when it is set,
+ * so that lines it has already buffered are not lost.
+ */
+extern LINE_READER *shellInput;
+
+
+
+/**
+ * Finds the builtin that handles a command.
+ *
+ * @param argc number of arguments
+ * @param argv the command's arguments
+ * @return the builtin, or NULL if the command is not a builtin
+ */
+const BUILTIN *find_builtin( int argc, char **argv );
+
+
+#endif
@@ -0,0 +1,157 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include "copy.h"
+
+#define COPY_CHUNK (1 << 30)    //bytes asked for per zero-copy call
+#define COPY_BUFFER (128 * 1024)        //buffer for the read/write fallback
+
+/* The zero-copy primitives, all with the same shape: move up to len
+ * bytes from inFd to outFd at their current positions */
+static ssize_t copyRange(int inFd, int outFd, size_t len)
+{
+    return copy_file_range(inFd, NULL, outFd, NULL, len, 0);
+}
+
+static ssize_t spliceRange(int inFd, int outFd, size_t len)
+{
+    return splice(inFd, NULL, outFd, NULL, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+}
+
+static ssize_t sendRange(int inFd, int outFd, size_t len)
+{
+    return sendfile(outFd, inFd, NULL, len);
+}
+
+/* Sleeps after EAGAIN until inFd has input and outFd has room again,
+ * for descriptors someone else made non-blocking */
+static void waitReady(int inFd, int outFd)
+{
+    struct pollfd in = { inFd, POLLIN, 0 };
+    struct pollfd out = { outFd, POLLOUT, 0 };
+
+    while (poll(&in, 1, -1) < 0 && errno == EINTR)
+    {
+    }
+    while (poll(&out, 1, -1) < 0 && errno == EINTR)
+    {
+    }
+}
+
+/* Runs one primitive until end of input. Returns 1 when done, or 0
+ * if the primitive is not supported for these descriptors and the
+ * caller should try the next one. *copied counts the bytes moved */
+static int copyWith(ssize_t (*move)(int, int, size_t), int inFd, int outFd, off_t *copied)
+{
+    ssize_t n;
+
+    for (;;)
+    {
+        n = move(inFd, outFd, COPY_CHUNK);
+        if (n > 0)
+        {
+            *copied += n;
+            continue;
+        }
+        if (n == 0)
+        {
+            return 1;
+        }
+        if (errno == EAGAIN)
+        {
+            waitReady(inFd, outFd);
+            continue;
+        }
+        if (errno == EINTR)
+        {
+            continue;
+        }
+        if (errno == EINVAL || errno == ENOSYS || errno == EXDEV || errno == EBADF
+            || errno == EOPNOTSUPP)
+        {
+            return 0;                                       //positions are shared, so the next method picks up here
+        }
+        return -1;
+    }
+}
+
+/* Copies inFd to outFd until end of input, in the kernel if possible */
+off_t copy_fd(int inFd, int outFd)
+{
+    struct stat in, out;
+    off_t copied = 0;
+    char buf[COPY_BUFFER];
+    ssize_t n, w, done;
+    int result;
+
+    if (fstat(inFd, &in) == -1 || fstat(outFd, &out) == -1)
+    {
+        return -1;
+    }
+
+    if (S_ISREG(in.st_mode) && S_ISREG(out.st_mode))
+    {
+        if ((result = copyWith(copyRange, inFd, outFd, &copied)) != 0)
+        {
+            return result < 0 ? -1 : copied;
+        }
+    }
+    if (S_ISFIFO(in.st_mode) || S_ISFIFO(out.st_mode))
+    {
+        if ((result = copyWith(spliceRange, inFd, outFd, &copied)) != 0)
+        {
+            return result < 0 ? -1 : copied;
+        }
+    }
+    if (S_ISREG(in.st_mode) || S_ISBLK(in.st_mode))
+    {
+        if ((result = copyWith(sendRange, inFd, outFd, &copied)) != 0)
+        {
+            return result < 0 ? -1 : copied;
+        }
+    }
+
+    for (;;)                                                //terminals, sockets and anything else
+    {
+        n = read(inFd, buf, sizeof(buf));
+        if (n == 0)
+        {
+            return copied;
+        }
+        if (n < 0)
+        {
+            if (errno == EAGAIN)
+            {
+                waitReady(inFd, outFd);
+                continue;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        for (done = 0; done < n; done += w)
+        {
+            w = write(outFd, buf + done, n - done);
+            if (w < 0)
+            {
+                if (errno == EAGAIN)
+                {
+                    waitReady(inFd, outFd);
+                }
+                if (errno == EINTR || errno == EAGAIN)
+                {
+                    w = 0;
+                    continue;
+                }
+                return -1;
+            }
+        }
+        copied += n;
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef __COPY_H__
+#define __COPY_H__
+
+
+#include <sys/types.h>
+
+
+
+/**
+ * Copies everything from one descriptor to another until end of
+ * input, keeping the data in the kernel wherever possible:
+ * copy_file_range between regular files, splice when either side is
+ * a pipe, sendfile from a regular file to anything else.  Plain
+ * read/write is the last resort.  Both descriptors' file positions
+ * are used and advanced.
+ *
+ * @param inFd descriptor to read from
+ * @param outFd descriptor to write to
+ * @return number of bytes copied, or -1 with errno set on error
+ */
+off_t copy_fd( int inFd, int outFd );
+
+
+#endif
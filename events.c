@@ -0,0 +1,214 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include "events.h"
+
+#define EVENT_BATCH 16          //events taken from epoll per wait
+
+typedef struct timer {
+    int fd;                     //timerfd, -1 if the slot is free
+    void (*fire)(void *arg);
+    void *arg;
+} TIMER;
+
+static int epollFd = -1;
+static int signalFd = -1;
+static sigset_t watched;                    //signals read from signalFd
+static void (*handlers[NSIG])(int sig);
+static TIMER *timers = NULL;                //looked up by fd when one fires
+static int ntimers = 0;
+
+/* Creates the epoll instance and the signalfd, which starts out
+ * watching no signals */
+void init_events(void)
+{
+    struct epoll_event ev;
+
+    sigemptyset(&watched);
+    if ((epollFd = epoll_create1(EPOLL_CLOEXEC)) < 0
+        || (signalFd = signalfd(-1, &watched, SFD_CLOEXEC | SFD_NONBLOCK)) < 0)
+    {
+        perror("Error creating event loop");
+        exit(EXIT_FAILURE);
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = signalFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, signalFd, &ev);
+}
+
+/* Blocks sig and adds it to the signalfd */
+void watch_signal(int sig, void (*handler)(int sig))
+{
+    handlers[sig] = handler;
+    sigaddset(&watched, sig);
+    sigprocmask(SIG_BLOCK, &watched, NULL);
+    signalfd(signalFd, &watched, 0);
+}
+
+/* Arms a timerfd and registers it with epoll */
+int add_timer(double seconds, void (*fire)(void *arg), void *arg)
+{
+    struct itimerspec when;
+    struct epoll_event ev;
+    int fd, i;
+
+    if ((fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)) < 0)
+    {
+        return -1;
+    }
+    memset(&when, 0, sizeof(when));
+    when.it_value.tv_sec = (time_t)seconds;
+    when.it_value.tv_nsec = (long)((seconds - (time_t)seconds) * 1e9);
+    if (when.it_value.tv_sec == 0 && when.it_value.tv_nsec == 0)
+    {
+        when.it_value.tv_nsec = 1;                          //all zero would disarm it
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (timerfd_settime(fd, 0, &when, NULL) < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    for (i = 0; i < ntimers && timers[i].fd != -1; i++)
+    {
+    }
+    if (i == ntimers)
+    {
+        int grownSize = ntimers ? ntimers * 2 : 8;
+        TIMER *grown = realloc(timers, grownSize * sizeof(TIMER));
+        int k;
+
+        if (grown == NULL)
+        {
+            close(fd);
+            return -1;
+        }
+        for (k = ntimers; k < grownSize; k++)
+        {
+            grown[k].fd = -1;
+        }
+        timers = grown;
+        ntimers = grownSize;
+    }
+    timers[i].fd = fd;
+    timers[i].fire = fire;
+    timers[i].arg = arg;
+    return fd;
+}
+
+/* Closing the timerfd also takes it out of the epoll set */
+void cancel_timer(int timer)
+{
+    int i;
+
+    for (i = 0; i < ntimers; i++)
+    {
+        if (timers[i].fd == timer)
+        {
+            close(timer);
+            timers[i].fd = -1;
+            return;
+        }
+    }
+}
+
+/* Runs the handler of every signal queued on the signalfd */
+static void readSignals(void)
+{
+    struct signalfd_siginfo info;
+
+    while (read(signalFd, &info, sizeof(info)) == sizeof(info))
+    {
+        if (handlers[info.ssi_signo] != NULL)
+        {
+            handlers[info.ssi_signo](info.ssi_signo);
+        }
+    }
+}
+
+/* Runs the handler of a timer that has fired. A handler earlier in
+ * the same batch may have cancelled it, so it is looked up first */
+static void fireTimer(int fd)
+{
+    unsigned long long expirations;
+    int i;
+
+    for (i = 0; i < ntimers; i++)
+    {
+        if (timers[i].fd == fd)
+        {
+            if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+            {
+                timers[i].fire(timers[i].arg);              //may cancel the timer itself
+            }
+            return;
+        }
+    }
+}
+
+/* Waits for signals, timers and optionally fd, and dispatches them.
+ * Returns -1 if epoll itself fails, which waiting again would not fix */
+int wait_for_event(int fd)
+{
+    struct epoll_event ev[EVENT_BATCH];
+    int readable = 0;
+    int n, i;
+
+    if (fd != -1)
+    {
+        memset(ev, 0, sizeof(ev[0]));
+        ev[0].events = EPOLLIN;
+        ev[0].data.fd = fd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev[0]) < 0)
+        {
+            return 1;                                       //regular files are never waited for
+        }
+    }
+    while ((n = epoll_wait(epollFd, ev, EVENT_BATCH, -1)) < 0 && errno == EINTR)
+    {
+    }
+    if (fd != -1)
+    {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    if (n < 0)
+    {
+        perror("epoll_wait");
+        return -1;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (ev[i].data.fd == fd)
+        {
+            readable = 1;
+        }
+        else if (ev[i].data.fd == signalFd)
+        {
+            readSignals();
+        }
+        else
+        {
+            fireTimer(ev[i].data.fd);
+        }
+    }
+    return readable;
+}
+
+/* Keeps the loop running while the shell waits for input */
+void wait_for_input(int fd)
+{
+    while (wait_for_event(fd) == 0)
+    {
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef __EVENTS_H__
+#define __EVENTS_H__
+
+
+
+/**
+ * Sets up the shell's event loop: one epoll instance watching a
+ * signalfd for the signals handed to watch_signal and a timerfd per
+ * pending timer.  Nothing happens asynchronously; handlers only run
+ * from inside wait_for_event, so they may touch any shell state.
+ */
+void init_events( void );
+
+
+
+/**
+ * Blocks a signal and delivers it through the event loop instead.
+ * Children must be started with an empty signal mask.
+ *
+ * @param sig the signal
+ * @param handler called from wait_for_event each time sig arrives
+ */
+void watch_signal( int sig, void (*handler)( int sig ) );
+
+
+
+/**
+ * Starts a one-shot timer.
+ *
+ * @param seconds how long from now it fires
+ * @param fire called from wait_for_event when it does
+ * @param arg passed to fire
+ * @return an id for cancel_timer, or -1 on error
+ */
+int add_timer( double seconds, void (*fire)( void *arg ), void *arg );
+
+
+
+/**
+ * Cancels a timer, whether or not it has fired.
+ * @param timer an id returned by add_timer
+ */
+void cancel_timer( int timer );
+
+
+
+/**
+ * Waits for the next batch of signals or timers and runs their
+ * handlers.  If fd is not -1, also returns as soon as it is
+ * readable.
+ *
+ * @param fd a descriptor to wait for as well, or -1
+ * @return 1 if fd is readable, 0 otherwise, or -1 after reporting an
+ *         error in the event loop itself; callers should stop waiting
+ */
+int wait_for_event( int fd );
+
+
+
+/**
+ * Runs handlers until fd is readable, or the event loop fails.
+ * Descriptors epoll cannot watch, such as regular files, are always
+ * readable.
+ * @param fd the descriptor about to be read
+ */
+void wait_for_input( int fd );
+
+
+#endif
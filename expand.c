@@ -0,0 +1,360 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "expand.h"
+#include "events.h"
+#include "jobs.h"
+#include "launch.h"
+
+#define CAPTURE_MIN_SIZE (64 * 1024)
+
+typedef struct word_list {
+    char **words;               //NULL-terminated, allocated from the arena
+    int count;
+    int capacity;
+} WORD_LIST;
+
+typedef struct field {
+    char *text;                 //the word being built, not null-terminated
+    size_t length;
+    size_t capacity;
+} FIELD;
+
+static char devNull[] = "/dev/null";    //standard input of substitutions that cannot have the terminal
+static char *captured = NULL;           //output of the latest substitution, mapped
+static size_t capturedSize = 0;         //size of the mapping
+
+/* Appends a word, growing the list geometrically */
+static void pushWord(ARENA *arena, WORD_LIST *list, char *word)
+{
+    if (list->count + 1 >= list->capacity)
+    {
+        char **words;
+
+        list->capacity = list->capacity ? list->capacity * 2 : 8;
+        words = arena_alloc(arena, list->capacity * sizeof(char *));
+        if (list->count > 0)
+        {
+            memcpy(words, list->words, list->count * sizeof(char *));
+        }
+        list->words = words;
+    }
+    list->words[list->count++] = word;
+    list->words[list->count] = NULL;
+}
+
+/* 1 for the characters substitution output is split on */
+static int isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+/* Appends text to the word being built */
+static void appendField(FIELD *field, const char *text, size_t length)
+{
+    if (field->length + length > field->capacity)
+    {
+        while (field->length + length > field->capacity)
+        {
+            field->capacity = field->capacity ? field->capacity * 2 : 64;
+        }
+        field->text = realloc(field->text, field->capacity);
+    }
+    memcpy(field->text + field->length, text, length);
+    field->length += length;
+}
+
+/* Doubles the capture buffer. mremap moves pages rather than copying
+ * them, so a multi-megabyte output is never copied as it grows */
+static int growCapture(void)
+{
+    size_t size = capturedSize ? capturedSize * 2 : CAPTURE_MIN_SIZE;
+    void *grown;
+
+    if (captured == NULL)
+    {
+        grown = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    else
+    {
+        grown = mremap(captured, capturedSize, size, MREMAP_MAYMOVE);
+    }
+    if (grown == MAP_FAILED)
+    {
+        return -1;
+    }
+    captured = grown;
+    capturedSize = size;
+    return 0;
+}
+
+/* Runs the command line in text as a job whose standard output is a
+ * pipe, reading it into the capture buffer until every writer has
+ * closed it. Reads go straight into the free end of the buffer, so
+ * each is as large as the space left. The event loop runs between
+ * reads, so the job can be interrupted or timed out; ^C kills it
+ * outright. Under job control the job is not in the terminal's
+ * foreground group, so it reads /dev/null rather than stopping on
+ * the terminal */
+static const char *capture(ARENA *arena, const char *text, size_t textLength, size_t *length)
+{
+    COMMAND parsed, command;
+    const char *error;
+    JOB *job;
+    ssize_t n;
+    int fd[2];
+    int ready;
+    int status;
+
+    *length = 0;
+    error = parse_command(arena, arena_strndup(arena, text, textLength), &parsed);
+    if (error != NULL)
+    {
+        return error;
+    }
+    if (parsed.nstages == 0)
+    {
+        return NULL;
+    }
+    if ((error = expand_command(arena, &parsed, &command)) != NULL)
+    {
+        return error;                                       //nested substitutions run first
+    }
+    if (command.stages[0].argc == 0)
+    {
+        return NULL;
+    }
+    command.background = 0;                                 //the output is needed now
+    if (get_job_terminal() != -1 && command.stages[0].infile == NULL && command.stages[0].here == NULL)
+    {
+        command.stages[0].infile = devNull;
+    }
+
+    if (pipe2(fd, O_CLOEXEC) < 0)
+    {
+        return "invalid: cannot create pipe for command substitution";
+    }
+    if (get_pipe_size() > 0)
+    {
+        fcntl(fd[1], F_SETPIPE_SZ, (int)get_pipe_size());
+    }
+    job = checkPipe(&command, fd[1]);
+    close(fd[1]);
+
+    while (1)
+    {
+        if (*length == capturedSize && growCapture() < 0)
+        {
+            break;                                          //keeps what fit, and lets the job see EPIPE
+        }
+        while ((ready = wait_for_event(fd[0])) == 0 && !interrupted)
+        {
+        }
+        if (ready < 0)
+        {
+            signal_job(job, SIGKILL);                       //the event loop failed: nothing more can be read safely
+            break;
+        }
+        if (interrupted)
+        {
+            signal_job(job, SIGKILL);                       //whatever it does with SIGINT, the output is not wanted
+            break;
+        }
+        if ((n = read(fd[0], captured + *length, capturedSize - *length)) > 0)
+        {
+            *length += n;
+        }
+        else if (n == 0 || errno != EINTR)
+        {
+            break;
+        }
+    }
+    close(fd[0]);
+
+    status = wait_job(job);
+    if (status == 128 + SIGINT || interrupted)
+    {
+        return "";
+    }
+    while (*length > 0 && captured[*length - 1] == '\n')
+    {
+        (*length)--;
+    }
+    return NULL;
+}
+
+/* Expands one word into zero or more. Text outside the substitutions
+ * sticks to the first and last word of their output */
+static const char *expandWord(ARENA *arena, const char *word, WORD_LIST *list)
+{
+    FIELD field = { NULL, 0, 0 };
+    const char *error = NULL;
+    int pending = 0;                                        //1 once field holds a word, even an empty one
+    size_t length, k, run;
+
+    while (*word != '\0')
+    {
+        const char *dollar = strstr(word, "$(");
+        const char *end = dollar != NULL ? dollar : word + strlen(word);
+        const char *close;
+
+        if (end > word)
+        {
+            appendField(&field, word, end - word);
+            pending = 1;
+        }
+        if (dollar == NULL)
+        {
+            break;
+        }
+        close = skip_substitution(dollar);                  //the parser checked it is there
+        if ((error = capture(arena, dollar + 2, close - 1 - (dollar + 2), &length)) != NULL)
+        {
+            break;
+        }
+        for (k = 0; k < length; k = run)
+        {
+            for (run = k; run < length && !isBlank(captured[run]); run++)
+            {
+            }
+            if (run > k)                                    //a run of word characters
+            {
+                appendField(&field, &captured[k], run - k);
+                pending = 1;
+            }
+            else                                            //a blank ends the word
+            {
+                if (pending)
+                {
+                    pushWord(arena, list, arena_strndup(arena, field.text, field.length));
+                }
+                field.length = 0;
+                pending = 0;
+                run++;
+            }
+        }
+        word = close;
+    }
+
+    if (error == NULL && pending)
+    {
+        pushWord(arena, list, arena_strndup(arena, field.text, field.length));
+    }
+    free(field.text);
+    return error;
+}
+
+/* Expands a redirection target, which must stay one word */
+static const char *expandTarget(ARENA *arena, char **target)
+{
+    WORD_LIST list = { NULL, 0, 0 };
+    const char *error;
+
+    if (*target == NULL || strstr(*target, "$(") == NULL)
+    {
+        return NULL;
+    }
+    if ((error = expandWord(arena, *target, &list)) != NULL)
+    {
+        return error;
+    }
+    if (list.count != 1)
+    {
+        return "invalid: ambiguous redirect";
+    }
+    *target = list.words[0];
+    return NULL;
+}
+
+/* Expands a here-string. Its words are joined back with single
+ * blanks, as it is one piece of input rather than arguments */
+static const char *expandHereString(ARENA *arena, STAGE *stage)
+{
+    WORD_LIST list = { NULL, 0, 0 };
+    const char *error;
+    size_t length = 0;
+    char *joined;
+    int k;
+
+    if (stage->here == NULL || stage->delimiter != NULL || strstr(stage->here, "$(") == NULL)
+    {
+        return NULL;
+    }
+    if ((error = expandWord(arena, stage->here, &list)) != NULL)
+    {
+        return error;
+    }
+    for (k = 0; k < list.count; k++)
+    {
+        length += strlen(list.words[k]) + 1;
+    }
+    joined = arena_alloc(arena, length + 1);
+    stage->here = joined;
+    for (k = 0; k < list.count; k++)
+    {
+        joined = stpcpy(joined, list.words[k]);
+        *joined++ = ' ';
+    }
+    *joined = '\0';
+    stage->hereLength = length > 0 ? length - 1 : 0;   //no blank after the last word
+    return NULL;
+}
+
+/* Expands every stage into new arrays, leaving the parsed command alone */
+const char *expand_command(ARENA *arena, COMMAND *command, COMMAND *expanded)
+{
+    COMMAND result = *command;
+    const char *error;
+    int i, k;
+
+    if (strstr(command->line, "$(") == NULL)
+    {
+        *expanded = *command;                               //the common case costs one scan of the line
+        return NULL;
+    }
+
+    result.stages = arena_alloc(arena, command->nstages * sizeof(STAGE));
+    for (i = 0; i < command->nstages; i++)
+    {
+        STAGE *stage = &result.stages[i];
+        WORD_LIST list = { NULL, 0, 0 };
+
+        *stage = command->stages[i];
+        for (k = 0; k < stage->argc; k++)
+        {
+            if (strstr(stage->argv[k], "$(") == NULL)
+            {
+                pushWord(arena, &list, stage->argv[k]);
+            }
+            else if ((error = expandWord(arena, stage->argv[k], &list)) != NULL)
+            {
+                return error;
+            }
+        }
+        if (list.count == 0)
+        {
+            if (command->nstages > 1)
+            {
+                return "invalid: missing command";
+            }
+            list.words = arena_alloc(arena, sizeof(char *));    //a single stage may expand to nothing at all
+            list.words[0] = NULL;
+        }
+        stage->argv = list.words;
+        stage->argc = list.count;
+        if ((error = expandTarget(arena, &stage->infile)) != NULL
+            || (error = expandTarget(arena, &stage->outfile)) != NULL
+            || (error = expandHereString(arena, stage)) != NULL)
+        {
+            return error;
+        }
+    }
+
+    *expanded = result;
+    return NULL;
+}
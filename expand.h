@@ -0,0 +1,30 @@
+#ifndef __EXPAND_H__
+#define __EXPAND_H__
+
+
+#include "arena.h"
+#include "parser.h"
+
+
+
+/**
+ * Performs the command substitutions of a parsed command.  Every
+ * $(...) is run as a job of its own with its standard output
+ * captured in memory; the output, less trailing newlines, is split
+ * on blanks into separate words, as in sh.  A redirection target
+ * must expand to exactly one word, and the words of a here-string
+ * are joined by blanks; here-document bodies are taken literally.
+ * The parsed command is left alone, so it may come from the parse
+ * cache.
+ *
+ * @param arena where the expanded stages and words are allocated
+ * @param command the parsed command
+ * @param expanded filled in with the command to run; a copy of
+ *        command if it has no substitutions
+ * @return NULL on success, otherwise a message describing the error.
+ *         The message is empty if a substitution was interrupted.
+ */
+const char *expand_command( ARENA *arena, COMMAND *command, COMMAND *expanded );
+
+
+#endif
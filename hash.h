@@ -0,0 +1,33 @@
+#ifndef __HASH_H__
+#define __HASH_H__
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+/**
+ * FNV-1a hash of a string, shared by the shell's hash tables.
+ *
+ * @param text a null-terminated string
+ * @param length if non-NULL, set to the length of text, which the
+ *        hash has to walk anyway
+ * @return the 64-bit hash, the same on every target
+ */
+static inline uint64_t fnv1a( const char *text, size_t *length )
+{
+  uint64_t hash = UINT64_C(14695981039346656037);
+  const char *c;
+
+  for( c = text; *c; c++ ) {
+    hash ^= (unsigned char)*c;
+    hash *= UINT64_C(1099511628211);
+  }
+  if( length != NULL )
+    *length = c - text;
+  return hash;
+}
+
+
+#endif
@@ -0,0 +1,291 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "history.h"
+
+static int logFd = -1;                  //one command per line, appended to only
+static int indexFd = -1;                //a uint64_t offset into the log per command
+static char *logMap = NULL;
+static size_t logMapped = 0;
+static uint64_t *offsets = NULL;        //the index, mapped
+static size_t indexMapped = 0;
+static size_t entryCount = 0;           //whole offsets in the index
+static uint32_t *sorted = NULL;         //entry numbers ordered by text, then age
+static size_t sortedCount = 0;          //entries merged into sorted so far
+
+/* Maps a file that only ever grows, or extends its mapping to the
+ * file's current size. The old mapping is kept if that fails */
+static void mapGrowing(int fd, void **map, size_t *mapped)
+{
+    struct stat st;
+    void *grown;
+
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size <= *mapped)
+    {
+        return;
+    }
+    if (*map == NULL)
+    {
+        grown = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    else
+    {
+        grown = mremap(*map, *mapped, st.st_size, MREMAP_MAYMOVE);
+    }
+    if (grown != MAP_FAILED)
+    {
+        *map = grown;
+        *mapped = st.st_size;
+    }
+}
+
+/* Picks up commands other shells appended since the last look. The
+ * index is mapped first: a line is in the log before its offset is
+ * in the index, so every offset seen points into the mapped log */
+static void refresh(void)
+{
+    mapGrowing(indexFd, (void **)&offsets, &indexMapped);
+    mapGrowing(logFd, (void **)&logMap, &logMapped);
+    entryCount = indexMapped / sizeof(uint64_t);
+}
+
+/* Returns the text of an entry, which is not null-terminated, and
+ * its length. A damaged entry reads as empty */
+static const char *entryText(size_t entry, size_t *length)
+{
+    uint64_t offset = offsets[entry];
+    const char *end;
+
+    if (offset >= logMapped)
+    {
+        *length = 0;
+        return "";
+    }
+    end = memchr(logMap + offset, '\n', logMapped - offset);
+    *length = (end != NULL ? end : logMap + logMapped) - (logMap + offset);
+    return logMap + offset;
+}
+
+/* Orders two texts like strcmp */
+static int compareText(const char *a, size_t aLength, const char *b, size_t bLength)
+{
+    int order = memcmp(a, b, aLength < bLength ? aLength : bLength);
+
+    if (order != 0)
+    {
+        return order;
+    }
+    return (aLength > bLength) - (aLength < bLength);
+}
+
+/* qsort comparator for entry numbers: by text, then oldest first */
+static int compareEntries(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    size_t xLength, yLength;
+    const char *xText = entryText(x, &xLength);
+    const char *yText = entryText(y, &yLength);
+    int order = compareText(xText, xLength, yText, yLength);
+
+    return order != 0 ? order : (x > y) - (x < y);
+}
+
+/* Brings the sorted index up to date. It is only built when a prefix
+ * is first looked up; after that, new entries are sorted on their
+ * own and merged in, so the work is proportional to what changed */
+static int syncSorted(void)
+{
+    uint32_t *merged;
+    size_t added, i, j, k;
+
+    refresh();
+    if (sortedCount == entryCount)
+    {
+        return 0;
+    }
+    if ((merged = malloc(entryCount * sizeof(uint32_t))) == NULL)
+    {
+        return -1;
+    }
+    added = entryCount - sortedCount;
+    for (k = 0; k < added; k++)
+    {
+        merged[sortedCount + k] = sortedCount + k;
+    }
+    qsort(merged + sortedCount, added, sizeof(uint32_t), compareEntries);
+
+    for (i = 0, j = sortedCount, k = 0; i < sortedCount || j < entryCount; k++)
+    {
+        if (j == entryCount || (i < sortedCount && compareEntries(&sorted[i], &merged[j]) < 0))
+        {
+            merged[k] = sorted[i++];
+        }
+        else
+        {
+            merged[k] = merged[j++];                    //k < j while old entries remain, so nothing unread is overwritten
+        }
+    }
+    free(sorted);
+    sorted = merged;
+    sortedCount = entryCount;
+    return 0;
+}
+
+/* Returns the most recent entry starting with prefix, or -1. A binary
+ * search finds the first entry not ordered before the prefix; every
+ * match follows it */
+static long findPrefix(const char *prefix, size_t length)
+{
+    size_t low = 0, high, textLength;
+    const char *text;
+    long best = -1;
+
+    if (syncSorted() < 0)
+    {
+        return -1;
+    }
+    high = sortedCount;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        text = entryText(sorted[middle], &textLength);
+        if (compareText(text, textLength, prefix, length) < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    for (; low < sortedCount; low++)
+    {
+        text = entryText(sorted[low], &textLength);
+        if (textLength < length || memcmp(text, prefix, length) != 0)
+        {
+            break;
+        }
+        if ((long)sorted[low] > best)
+        {
+            best = sorted[low];
+        }
+    }
+    return best;
+}
+
+/* Opens, or creates, the log and its index */
+int open_history(const char *path)
+{
+    char *indexPath;
+
+    if (asprintf(&indexPath, "%s.idx", path) < 0)
+    {
+        return -1;
+    }
+    logFd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    indexFd = open(indexPath, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    free(indexPath);
+    if (logFd < 0 || indexFd < 0)
+    {
+        if (logFd >= 0)
+        {
+            close(logFd);
+        }
+        logFd = indexFd = -1;
+        return -1;
+    }
+    refresh();
+    return 0;
+}
+
+/* Appends the line, then its offset. Each is a single O_APPEND write,
+ * so lines from concurrent shells never interleave, and the file
+ * position after the write says where this one landed */
+void history_add(const char *line, size_t length)
+{
+    struct iovec parts[2] = { { (char *)line, length }, { "\n", 1 } };
+    uint64_t offset;
+    off_t end;
+
+    if (logFd < 0)
+    {
+        return;
+    }
+    if (writev(logFd, parts, 2) != (ssize_t)length + 1 || (end = lseek(logFd, 0, SEEK_CUR)) < 0)
+    {
+        return;
+    }
+    offset = end - length - 1;
+    if (write(indexFd, &offset, sizeof(offset)) != sizeof(offset))
+    {
+        perror("history");                              //the line stays in the log, unindexed
+    }
+}
+
+/* Replaces a leading !! or !prefix with the command it names */
+const char *history_expand(ARENA *arena, char **line)
+{
+    static char error[128];
+    const char *designator = *line + 1;
+    size_t length = strcspn(designator, " \t");
+    size_t textLength, restLength;
+    const char *text;
+    char *expanded;
+    long entry = -1;
+
+    if (**line != '!' || length == 0 || logFd < 0)
+    {
+        return NULL;
+    }
+    if (length == 1 && designator[0] == '!')
+    {
+        refresh();
+        entry = (long)entryCount - 1;
+    }
+    else
+    {
+        entry = findPrefix(designator, length);
+    }
+    if (entry < 0)
+    {
+        snprintf(error, sizeof(error), "!%.*s: event not found", (int)length, designator);
+        return error;
+    }
+
+    text = entryText(entry, &textLength);
+    restLength = strlen(designator + length);
+    expanded = arena_alloc(arena, textLength + restLength + 1);
+    memcpy(expanded, text, textLength);
+    memcpy(expanded + textLength, designator + length, restLength + 1);
+    *line = expanded;
+    return NULL;
+}
+
+/* Prints the newest count entries, oldest first */
+void history_print(int fd, size_t count)
+{
+    size_t entry, length;
+    const char *text;
+    FILE *out;
+
+    if (logFd < 0 || (out = fdopen(dup(fd), "w")) == NULL)
+    {
+        return;
+    }
+    refresh();
+    entry = count != 0 && count < entryCount ? entryCount - count : 0;
+    for (; entry < entryCount; entry++)
+    {
+        text = entryText(entry, &length);
+        fprintf(out, "%5zu  %.*s\n", entry + 1, (int)length, text);
+    }
+    fclose(out);
+}
@@ -0,0 +1,57 @@
+#ifndef __HISTORY_H__
+#define __HISTORY_H__
+
+
+#include "arena.h"
+
+
+
+/**
+ * Opens the history log and its offset index, creating them if
+ * needed.  The log holds one command per line; the index, at the
+ * same path with ".idx" appended, holds the 64-bit offset of every
+ * line.  Both are only ever appended to with O_APPEND and are mapped
+ * rather than read, so opening costs the same however long the
+ * history is, and any number of shells may share one log.
+ *
+ * @param path the log file
+ * @return 0 on success, -1 with errno set otherwise
+ */
+int open_history( const char *path );
+
+
+
+/**
+ * Appends a command line to the history.  Does nothing if no history
+ * is open.
+ * @param line the line, without its newline
+ * @param length the length of line
+ */
+void history_add( const char *line, size_t length );
+
+
+
+/**
+ * Expands a line starting with `!!` (the previous command) or
+ * `!prefix` (the most recent command starting with prefix).  The
+ * designator runs up to the first blank; the rest of the line is
+ * appended to the recalled command.  Other lines are left alone.
+ *
+ * @param arena where the expanded line is allocated
+ * @param line the line; replaced by the expansion, if any
+ * @return NULL on success, otherwise a message describing the error.
+ */
+const char *history_expand( ARENA *arena, char **line );
+
+
+
+/**
+ * Writes the last count entries of the history, numbered, in the
+ * format of bash's history builtin.
+ * @param fd where to write
+ * @param count how many entries to write; 0 for all of them
+ */
+void history_print( int fd, size_t count );
+
+
+#endif
@@ -0,0 +1,500 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/wait.h>
+#include "jobs.h"
+#include "stats.h"
+#include "trace.h"
+#include "events.h"
+
+static JOB **table = NULL;      //job n lives in table[n - 1]; free slots are NULL
+static int tableSize = 0;
+static JOB *foreground = NULL;  //job being waited for, if any
+static double jobTimeout = 0;   //seconds each new job may run, 0 for no limit
+static int terminalFd = -1;     //terminal foreground jobs are given, or -1 without job control
+static struct termios shellModes;       //terminal settings restored after each foreground job
+int interrupted = 0;
+
+/* Exit status of a reaped child the way shells report it */
+static int statusOf(int status)
+{
+    return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+/* Stores a reaped child's status and resource usage in the job it
+ * belongs to */
+static void recordExit(pid_t pid, int status, struct rusage *usage)
+{
+    int i, k;
+
+    for (i = 0; i < tableSize; i++)
+    {
+        JOB *job = table[i];
+
+        if (job == NULL)
+        {
+            continue;
+        }
+        for (k = 0; k < job->npids; k++)
+        {
+            if (job->pids[k] == pid && WIFSTOPPED(status))
+            {
+                if (job->stats[k].status != STAGE_STOPPED)
+                {
+                    job->stats[k].status = STAGE_STOPPED;
+                    job->stopped++;
+                }
+                return;
+            }
+            if (job->pids[k] == pid)
+            {
+                if (job->stats[k].status == STAGE_STOPPED)
+                {
+                    job->stopped--;                         //killed while stopped
+                }
+                job->pids[k] = 0;                           //reaped; never signal it again
+                job->stats[k].status = statusOf(status);
+                job->stats[k].usage = *usage;
+                clock_gettime(CLOCK_MONOTONIC, &job->stats[k].ended);
+                if (pid == job->lastPid)
+                {
+                    job->status = statusOf(status);
+                }
+                job->remaining--;
+                return;
+            }
+        }
+    }
+}
+
+/* Reaps every child that has exited without blocking and records
+ * its status and rusage in the job table. Runs from the event loop
+ * when SIGCHLD arrives, so nothing is reaped behind the shell's back */
+static void reapChildren(int sig)
+{
+    struct rusage usage;
+    int status;
+    pid_t pid;
+
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED, &usage)) > 0)
+    {
+        recordExit(pid, status, &usage);
+    }
+}
+
+/* Has the event loop deliver SIGCHLD to reapChildren */
+void init_jobs(void)
+{
+    watch_signal(SIGCHLD, reapChildren);
+}
+
+/* Turns on job control for an interactive shell */
+void set_job_terminal(int fd)
+{
+    signal(SIGTSTP, SIG_IGN);                               //^Z stops the job, not the shell
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);                               //so tcsetpgrp works from the background
+    signal(SIGQUIT, SIG_IGN);
+    tcgetattr(fd, &shellModes);
+    terminalFd = fd;
+}
+
+/* Returns the job control terminal, or -1 */
+int get_job_terminal(void)
+{
+    return terminalFd;
+}
+
+/* Sets how long jobs started from now on may run */
+void set_job_timeout(double seconds)
+{
+    jobTimeout = seconds > 0 ? seconds : 0;
+}
+
+/* Returns the timeout given to new jobs, 0 for none */
+double get_job_timeout(void)
+{
+    return jobTimeout;
+}
+
+/* Signals every stage of a job: the whole process group at once, or
+ * each unreaped stage when they share the shell's group because job
+ * control is off. Returns 1 if any stage was signalled */
+int signal_job(JOB *job, int sig)
+{
+    int k, signalled = 0;
+
+    if (job->pgid > 0)
+    {
+        return kill(-job->pgid, sig) == 0;
+    }
+    for (k = 0; k < job->npids; k++)
+    {
+        if (job->stats[k].status < 0 && kill(job->pids[k], sig) == 0)
+        {
+            signalled = 1;
+        }
+    }
+    return signalled;
+}
+
+/* Timer handler: kills every stage of a job that ran out of time */
+static void jobTimedOut(void *arg)
+{
+    JOB *job = arg;
+
+    cancel_timer(job->timer);
+    job->timer = -1;
+    if (job->remaining > 0 && signal_job(job, SIGKILL))     //every stage, stopped or not, at once
+    {
+        write(STDOUT_FILENO, "Bwahaha ... tonight I dine on turtle soup\n", 42);
+    }
+}
+
+/* Adds a job under the lowest free number, with its own timer if a
+ * timeout is set */
+JOB *create_job(const char *text, int nstages, int background)
+{
+    JOB *job = calloc(1, sizeof(JOB));
+    int id;
+
+    if (job == NULL || (job->pids = calloc(nstages, sizeof(pid_t))) == NULL
+        || (job->stats = calloc(nstages, sizeof(STAGE_STATS))) == NULL)
+    {
+        perror("invalid: Error in allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    for (id = 1; id <= tableSize && table[id - 1] != NULL; id++)
+    {
+    }
+    if (id > tableSize)
+    {
+        JOB **grown = realloc(table, (tableSize ? tableSize * 2 : 8) * sizeof(JOB *));
+
+        if (grown == NULL)
+        {
+            perror("invalid: Error in allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        table = grown;
+        memset(table + tableSize, 0, (tableSize ? tableSize : 8) * sizeof(JOB *));
+        tableSize = tableSize ? tableSize * 2 : 8;
+    }
+
+    job->id = id;
+    job->text = strdup(text);
+    if (background && job->text != NULL)
+    {
+        size_t len = strlen(job->text);                     //the & is shown by describeJob while it runs
+
+        while (len > 0 && (job->text[len - 1] == '&' || job->text[len - 1] == ' ' || job->text[len - 1] == '\t'))
+        {
+            job->text[--len] = '\0';
+        }
+    }
+    job->background = background;
+    job->lastPid = -1;
+    job->status = 0;
+    job->timer = jobTimeout > 0 ? add_timer(jobTimeout, jobTimedOut, job) : -1;
+    table[id - 1] = job;
+    return job;
+}
+
+/* Records a launched stage. With job control the first one leads the
+ * job's process group; without it every stage stays in the shell's */
+void add_job_pid(JOB *job, pid_t pid, const char *name, int last)
+{
+    STAGE_STATS *stats = &job->stats[job->npids];
+
+    stats->pid = pid;
+    stats->name = strdup(name);
+    stats->status = STAGE_RUNNING;
+    clock_gettime(CLOCK_MONOTONIC, &stats->started);
+    job->pids[job->npids++] = pid;
+    if (job->pgid == 0 && terminalFd != -1)
+    {
+        job->pgid = pid;
+    }
+    job->remaining++;
+    if (last)
+    {
+        job->lastPid = pid;
+    }
+}
+
+/* Removes a finished job from the table, logging what it cost.
+ * The stage names of the job removed last
+ * are kept until the next removal so collect_job can hand them back */
+static void removeJob(JOB *job)
+{
+    static STAGE_STATS *retired = NULL;
+    static int nretired = 0;
+    int k;
+
+    log_stats(job->text, job->status, job->stats, job->npids);
+    trace_stages(job->stats, job->npids);
+    for (k = 0; k < nretired; k++)
+    {
+        free(retired[k].name);
+    }
+    free(retired);
+    retired = job->stats;
+    nretired = job->npids;
+
+    if (job->timer != -1)
+    {
+        cancel_timer(job->timer);
+    }
+    table[job->id - 1] = NULL;
+    free(job->pids);
+    free(job->text);
+    free(job);
+}
+
+/* Waits for every stage of a job, removes it from the table and
+ * returns its exit status */
+int wait_job(JOB *job)
+{
+    return collect_job(job, NULL);
+}
+
+/* Gives the terminal to a foreground job, or back to the shell */
+static void handTerminal(JOB *job)
+{
+    if (terminalFd == -1)
+    {
+        return;
+    }
+    if (job != NULL)
+    {
+        tcsetpgrp(terminalFd, job->pgid);
+        return;
+    }
+    tcsetpgrp(terminalFd, getpgrp());
+    tcsetattr(terminalFd, TCSADRAIN, &shellModes);          //whatever the job did to the terminal
+}
+
+/* Describes a job's state for jobs and notices */
+static void describeJob(int fd, JOB *job, const char *state);
+
+/* Waits for every stage of a job, copies out what each one cost,
+ * removes the job from the table and returns its exit status. A
+ * job that stops is kept, as a background job */
+int collect_job(JOB *job, STAGE_STATS *stats)
+{
+    int status;
+
+    trace_begin("wait", job->text);
+    foreground = job;
+    if (job->terminal && job->pgid > 0)
+    {
+        handTerminal(job);
+    }
+    while (job->remaining > 0 && job->stopped < job->remaining && !(interrupted && job->background))
+    {
+        if (wait_for_event(-1) < 0)                         //reaps children and fires timers
+        {
+            break;                                          //nothing would ever be reaped; leave the job be
+        }
+    }
+    if (job->terminal && job->pgid > 0)
+    {
+        handTerminal(NULL);
+    }
+    foreground = NULL;
+    trace_end("wait");
+    if (stats != NULL)
+    {
+        memcpy(stats, job->stats, job->npids * sizeof(STAGE_STATS));
+    }
+    if (job->stopped < job->remaining)
+    {
+        if (!interrupted)
+        {
+            return 1;                                       //the event loop failed
+        }
+        if (terminalFd != -1)
+        {
+            dprintf(STDERR_FILENO, "\n");                   //the terminal echoed ^C mid-line
+        }
+        return 128 + SIGINT;                                //still running in the background
+    }
+    if (job->remaining > 0)
+    {
+        job->background = 1;                                //fg or bg lets it run again
+        dprintf(STDERR_FILENO, "\n");
+        describeJob(STDERR_FILENO, job, "Stopped");
+        return 128 + SIGTSTP;
+    }
+    status = job->status;
+    if (job->terminal && status == 128 + SIGINT)
+    {
+        write(STDOUT_FILENO, "\n", 1);                       //the terminal echoed ^C mid-line
+    }
+    removeJob(job);
+    return status;
+}
+
+/* Sends SIGCONT to a stopped job's process group */
+void continue_job(JOB *job, int background)
+{
+    job->background = background;
+    job->terminal = !background && terminalFd != -1;
+    if (job->stopped > 0)
+    {
+        int k;
+
+        for (k = 0; k < job->npids; k++)
+        {
+            if (job->stats[k].status == STAGE_STOPPED)
+            {
+                job->stats[k].status = STAGE_RUNNING;
+            }
+        }
+        job->stopped = 0;
+        if (job->terminal)
+        {
+            handTerminal(job);                              //before it can try to read
+        }
+        signal_job(job, SIGCONT);
+    }
+}
+
+/* Signals every job the shell is waiting for: the foreground job,
+ * parallel's jobs and any other job not left in the background */
+int signal_jobs(int sig)
+{
+    int i, signalled = 0;
+
+    for (i = 0; i < tableSize; i++)
+    {
+        JOB *job = table[i];
+
+        if (job != NULL && !job->background && job->remaining > 0 && signal_job(job, sig))
+        {
+            signalled++;
+        }
+    }
+    return signalled;
+}
+
+/* Finds a job by its number */
+JOB *find_job(int id)
+{
+    return id >= 1 && id <= tableSize ? table[id - 1] : NULL;
+}
+
+/* Finds the job one of whose stages has the given pid */
+JOB *find_job_by_pid(pid_t pid)
+{
+    int i, k;
+
+    for (i = 0; i < tableSize; i++)
+    {
+        for (k = 0; table[i] != NULL && k < table[i]->npids; k++)
+        {
+            if (table[i]->pids[k] == pid)
+            {
+                return table[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Returns the most recently started job still in the table */
+JOB *current_job(void)
+{
+    int i;
+
+    for (i = tableSize - 1; i >= 0; i--)
+    {
+        if (table[i] != NULL && table[i] != foreground)
+        {
+            return table[i];
+        }
+    }
+    return NULL;
+}
+
+/* Returns the most recent job with a stage that is still running */
+JOB *running_job(void)
+{
+    int i;
+
+    for (i = tableSize - 1; i >= 0; i--)
+    {
+        if (table[i] != NULL && table[i] != foreground && table[i]->stopped < table[i]->remaining)
+        {
+            return table[i];
+        }
+    }
+    return NULL;
+}
+
+/* Returns the job being waited for in the foreground */
+JOB *foreground_job(void)
+{
+    return foreground;
+}
+
+/* Describes a job's state for jobs and notices */
+static void describeJob(int fd, JOB *job, const char *state)
+{
+    dprintf(fd, "[%d]%c  %-24s%s%s\n", job->id, job == current_job() ? '+' : ' ',
+            state, job->text, job->background && job->remaining > job->stopped ? " &" : "");
+}
+
+/* Lists every background job and its state */
+void print_jobs(int fd)
+{
+    char state[32];
+    int i;
+
+    for (i = 0; i < tableSize; i++)
+    {
+        JOB *job = table[i];
+
+        if (job == NULL || job == foreground)
+        {
+            continue;
+        }
+        if (job->remaining > 0)
+        {
+            describeJob(fd, job, job->stopped >= job->remaining ? "Stopped" : "Running");
+        }
+        else
+        {
+            snprintf(state, sizeof(state), job->status ? "Exit %d" : "Done", job->status);
+            describeJob(fd, job, state);
+        }
+    }
+}
+
+/* Reports and removes background jobs that have finished */
+void reap_finished_jobs(int fd)
+{
+    char state[32];
+    int i;
+
+    reapChildren(SIGCHLD);                                  //scripts may not have waited since they ended
+    for (i = 0; i < tableSize; i++)
+    {
+        JOB *job = table[i];
+
+        if (job == NULL || !job->background || job->remaining > 0)
+        {
+            continue;
+        }
+        if (fd != -1)
+        {
+            snprintf(state, sizeof(state), job->status ? "Exit %d" : "Done", job->status);
+            describeJob(fd, job, state);
+        }
+        removeJob(job);
+    }
+}
@@ -0,0 +1,244 @@
+#ifndef __JOBS_H__
+#define __JOBS_H__
+
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <time.h>
+
+
+
+/**
+ * What one stage of a job cost, as reported by wait4 when it was
+ * reaped.
+ */
+typedef struct stage_stats {
+  pid_t pid;			/* the stage's pid, 0 if it never started */
+  char *name;			/* argv[0] of the stage */
+  int status;			/* its exit status once reaped, until then
+				   STAGE_RUNNING or STAGE_STOPPED */
+  struct timespec started;	/* CLOCK_MONOTONIC when it was launched */
+  struct timespec ended;	/* CLOCK_MONOTONIC when it was reaped */
+  struct rusage usage;		/* CPU, max RSS and context switches */
+} STAGE_STATS;
+
+#define STAGE_RUNNING -1
+#define STAGE_STOPPED -2
+
+
+
+/**
+ * A launched pipeline.  Its children are reaped from the event loop
+ * when SIGCHLD arrives, and each one's status is recorded here.
+ */
+typedef struct job {
+  int id;			/* job number shown as [id] */
+  char *text;			/* the command line, for jobs and notices */
+  int background;		/* 1 if started with & or stopped */
+  int terminal;			/* 1 if it is given the terminal in the foreground */
+  pid_t pgid;			/* process group of every stage, 0 until one
+				   starts or without job control */
+  pid_t *pids;			/* one per launched stage */
+  STAGE_STATS *stats;		/* parallel to pids */
+  int npids;			/* number of entries in pids */
+  int remaining;		/* launched stages not yet reaped */
+  int stopped;			/* stages stopped since the job last ran */
+  pid_t lastPid;		/* pid of the last stage, or -1 */
+  int status;			/* exit status of the job */
+  int timer;			/* event loop timer that kills it, or -1 */
+} JOB;
+
+
+
+/**
+ * Set when SIGINT reaches the shell itself, and cleared by the shell
+ * before each command line.  Waits that ^C should abandon check it.
+ */
+extern int interrupted;
+
+
+
+/**
+ * Has the event loop reap children when SIGCHLD arrives.  Must be
+ * called after init_events and before any job is created.  Since
+ * reaping only happens while the shell waits for events, no child
+ * can be reaped before its pid is recorded.
+ */
+void init_jobs( void );
+
+
+
+/**
+ * Enables job control on a terminal: the shell ignores the stop
+ * signals, remembers the terminal's settings, and from then on
+ * foreground jobs are made the terminal's foreground process group
+ * while they run and the shell takes it back afterwards.
+ *
+ * @param fd the terminal, normally standard input
+ */
+void set_job_terminal( int fd );
+
+
+
+/**
+ * Returns the terminal set by set_job_terminal, or -1.
+ */
+int get_job_terminal( void );
+
+
+
+/**
+ * Sets the time limit for jobs created from now on.  Each job gets
+ * its own timer; when it fires every stage of the job is killed.
+ *
+ * @param seconds the limit, or 0 for none
+ */
+void set_job_timeout( double seconds );
+
+
+
+/**
+ * Returns the time limit given to new jobs, 0 if there is none.
+ */
+double get_job_timeout( void );
+
+
+
+/**
+ * Adds a job to the table, starting its timer if there is a time
+ * limit.
+ *
+ * @param text the command line; it is copied
+ * @param nstages the most pids that will be added
+ * @param background 1 if the job runs in the background
+ * @return the new job
+ */
+JOB *create_job( const char *text, int nstages, int background );
+
+
+
+/**
+ * Records a launched stage.
+ *
+ * @param job the job the stage belongs to
+ * @param pid the stage's pid
+ * @param name the stage's argv[0], for statistics; it is copied
+ * @param last 1 if this is the last stage of the pipeline
+ */
+void add_job_pid( JOB *job, pid_t pid, const char *name, int last );
+
+
+
+/**
+ * Waits until every stage of a job has been reaped, removes it from
+ * the table and returns its exit status.  If the job is stopped
+ * instead, it is left in the table as a background job and
+ * 128 + SIGTSTP is returned.  A wait for a background job, which
+ * ^C is not passed on to, gives up once interrupted is set and
+ * returns 128 + SIGINT with the job still running.
+ * @param job a job in the table
+ * @return the exit status of the last stage
+ */
+int wait_job( JOB *job );
+
+
+
+/**
+ * Like wait_job, but also hands back what each stage cost before
+ * the job is removed.
+ * @param job a job in the table
+ * @param stats filled in with job->npids entries, if non-NULL; the
+ *        names stay valid until the next job is removed
+ * @return the exit status of the last stage
+ */
+int collect_job( JOB *job, STAGE_STATS *stats );
+
+
+
+/**
+ * Lets a stopped job run again, in the background or not.
+ * @param job a job in the table
+ * @param background 1 to leave it in the background
+ */
+void continue_job( JOB *job, int background );
+
+
+
+/**
+ * Sends a signal to every stage of a job not yet reaped: to its
+ * process group, or stage by stage without job control.
+ * @param job a job in the table
+ * @param sig the signal
+ * @return 1 if any stage was signalled, 0 otherwise
+ */
+int signal_job( JOB *job, int sig );
+
+
+
+/**
+ * Sends a signal to every job the shell is waiting for rather than
+ * running in the background.
+ * @param sig the signal
+ * @return the number of jobs signalled
+ */
+int signal_jobs( int sig );
+
+
+
+/**
+ * Finds a job by its number.
+ * @param id the job number
+ * @return the job, or NULL if there is none
+ */
+JOB *find_job( int id );
+
+
+
+/**
+ * Finds the job one of whose stages has the given pid.
+ * @param pid a process id
+ * @return the job, or NULL if there is none
+ */
+JOB *find_job_by_pid( pid_t pid );
+
+
+
+/**
+ * Returns the most recently started job still in the table, or NULL.
+ */
+JOB *current_job( void );
+
+
+
+/**
+ * Like current_job, but skips jobs whose stages are all stopped or
+ * finished, which waiting for would never end.
+ */
+JOB *running_job( void );
+
+
+
+/**
+ * Returns the job the shell is waiting for in the foreground, or NULL.
+ */
+JOB *foreground_job( void );
+
+
+
+/**
+ * Lists every job in the table and its state.
+ * @param fd where to write
+ */
+void print_jobs( int fd );
+
+
+
+/**
+ * Reports background jobs that have finished since the last call
+ * and removes them from the table.
+ * @param fd where to write the notices, or -1 to remove silently
+ */
+void reap_finished_jobs( int fd );
+
+
+#endif
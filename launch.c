@@ -0,0 +1,531 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <spawn.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "launch.h"
+#include "pathcache.h"
+#include "jobs.h"
+#include "trace.h"
+#include "builtins.h"
+#include "zygote.h"
+#include "events.h"
+
+extern char **environ;
+
+static LAUNCH_MODE launchMode = LAUNCH_SPAWN;   //posix_spawn unless asked otherwise
+static long pipeSize = 0;                       //F_SETPIPE_SZ for pipeline pipes; 0 keeps the default
+
+/* Selects how stages are launched: "fork", "spawn" or "zygote".
+ * Returns 0 if the name is unknown or the helper cannot be started */
+int set_launch_mode(const char *name)
+{
+    if (!strcmp(name, "zygote"))
+    {
+        if (start_zygote() < 0)
+        {
+            perror("zygote");
+            return 0;
+        }
+        launchMode = LAUNCH_ZYGOTE;
+        return 1;
+    }
+    if (strcmp(name, "fork") != 0 && strcmp(name, "spawn") != 0)
+    {
+        return 0;
+    }
+    stop_zygote();
+    launchMode = !strcmp(name, "fork") ? LAUNCH_FORK : LAUNCH_SPAWN;
+    return 1;
+}
+
+/* Returns the name of the current launch mode */
+const char *get_launch_mode(void)
+{
+    return launchMode == LAUNCH_FORK ? "fork" : launchMode == LAUNCH_ZYGOTE ? "zygote" : "spawn";
+}
+
+/* Reads the largest pipe size an unprivileged process may ask for */
+static long pipeMaxSize(void)
+{
+    char buf[32];
+    long max = 1048576;                                     //the kernel's default limit
+    int fd = open("/proc/sys/fs/pipe-max-size", O_RDONLY | O_CLOEXEC);
+    ssize_t n;
+
+    if (fd >= 0)
+    {
+        if ((n = read(fd, buf, sizeof(buf) - 1)) > 0)
+        {
+            buf[n] = '\0';
+            max = atol(buf);
+        }
+        close(fd);
+    }
+    return max;
+}
+
+/* Sets the buffer size requested for pipeline pipes, clamped to
+ * pipe-max-size. 0 restores the kernel default */
+long set_pipe_size(long bytes)
+{
+    long max = pipeMaxSize();
+
+    pipeSize = bytes < 0 ? 0 : bytes > max ? max : bytes;
+    return pipeSize;
+}
+
+/* Returns the pipe buffer size being requested */
+long get_pipe_size(void)
+{
+    return pipeSize;
+}
+
+/* Creates a pipe the way checkPipe does and reports its real size */
+long get_effective_pipe_size(void)
+{
+    int fd[2];
+    long size;
+
+    if (pipe2(fd, O_CLOEXEC) < 0)
+    {
+        return -1;
+    }
+    if (pipeSize > 0)
+    {
+        fcntl(fd[1], F_SETPIPE_SZ, (int)pipeSize);
+    }
+    size = fcntl(fd[1], F_GETPIPE_SZ);
+    close(fd[0]);
+    close(fd[1]);
+    return size;
+}
+
+/* Signals an interactive shell ignores or reads from its signalfd,
+ * all of which a child must get with their default action */
+static const int jobSignals[] = { SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU, SIGCHLD };
+
+/* Puts a new child in its job's process group, gives that group the
+ * terminal if ttyFd is set, undoes the shell's signal setup and
+ * installs its standard input and output. The terminal is taken
+ * with every signal blocked, so the child cannot stop itself on
+ * SIGTTOU doing it */
+void enter_stage(int inFd, int outFd, pid_t pgid, int ttyFd)
+{
+    sigset_t set;
+    size_t i;
+
+    sigfillset(&set);
+    sigprocmask(SIG_SETMASK, &set, NULL);
+    setpgid(0, pgid);
+    if (ttyFd != -1)
+    {
+        tcsetpgrp(ttyFd, getpgrp());
+    }
+    for (i = 0; i < sizeof(jobSignals) / sizeof(jobSignals[0]); i++)
+    {
+        signal(jobSignals[i], SIG_DFL);
+    }
+    if (inFd != -1)
+    {
+        dup2(inFd, 0);                                          //inFd is set for standard input
+    }
+    if (outFd != -1)
+    {
+        dup2(outFd, 1);                                         //outFd is set for standard output
+    }
+    sigemptyset(&set);
+    sigprocmask(SIG_SETMASK, &set, NULL);                       //the shell keeps SIGCHLD and SIGINT blocked for its signalfd
+}
+
+/* Becomes the program at path. A cached path that has gone away is
+ * reported to the parent before falling back to a full execvp search */
+void exec_stage(const char *path, char **argv, int reportFd)
+{
+    int error;
+
+    execv(path, argv);
+    if (errno == ENOENT && strcmp(path, argv[0]) != 0)
+    {
+        error = ENOENT;
+        if (reportFd != -1 && write(reportFd, &error, sizeof(error)) < 0)
+        {
+            _exit(1);
+        }
+        execvp(argv[0], argv);
+    }
+    perror("invalid: Wrong arguments for execvp");
+    _exit(1);                                                   //never flush the shell's stdio buffers twice
+}
+
+/* Waits for the child's exec and forgets the cached path if it said
+ * the file had gone */
+static void checkExecReport(int reportFd, const char *name)
+{
+    int error = 0;
+    ssize_t n;
+
+    while ((n = read(reportFd, &error, sizeof(error))) < 0 && errno == EINTR)
+    {
+    }
+    if (n == sizeof(error) && error == ENOENT)
+    {
+        pathcache_forget(name);
+    }
+    close(reportFd);
+}
+
+/* Copies the whole shell with fork, sets up standard input and
+ * output in the child and replaces it with the program at path.
+ * If the cached path has gone away the child falls back to a full
+ * execvp search and tells the shell through a close-on-exec pipe,
+ * so the entry is dropped here as in spawn mode */
+static pid_t launchWithFork(STAGE *stage, const char *path, int inFd, int outFd, pid_t pgid, int ttyFd)
+{
+    int report[2] = { -1, -1 };
+    pid_t pid;
+
+    if (strcmp(path, stage->argv[0]) != 0 && pipe2(report, O_CLOEXEC) < 0)
+    {
+        report[0] = report[1] = -1;                             //the exec still works, only unreported
+    }
+    if ((pid = fork()) < 0)
+    {
+        perror("invalid: Error in creating child process");
+        if (report[0] != -1)
+        {
+            close(report[0]);
+            close(report[1]);
+        }
+        return -1;
+    }
+    if (pid == 0)
+    {
+        enter_stage(inFd, outFd, pgid, ttyFd);
+        exec_stage(path, stage->argv, report[1]);
+    }
+    setpgid(pid, pgid ? pgid : pid);                            //also done here, so later stages can join at once
+    if (report[0] != -1)
+    {
+        close(report[1]);
+        checkExecReport(report[0], stage->argv[0]);
+    }
+    return pid;
+}
+
+/* Starts the stage with posix_spawnp, which glibc implements with
+ * a vfork-style clone: the shell's address space is shared, not
+ * copied, until the new program is loaded. The dup2s are done by
+ * spawn file actions. Exec failures are reported back here by
+ * posix_spawn itself, so a cached path that no longer exists is
+ * forgotten and looked up once more */
+static pid_t launchWithSpawn(STAGE *stage, const char *path, int inFd, int outFd, pid_t pgid, int ttyFd)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t none, defaults;
+    pid_t pid;
+    int error;
+    size_t i;
+
+    posix_spawnattr_init(&attr);
+    sigemptyset(&none);
+    sigemptyset(&defaults);
+    for (i = 0; i < sizeof(jobSignals) / sizeof(jobSignals[0]); i++)
+    {
+        sigaddset(&defaults, jobSignals[i]);
+    }
+    posix_spawnattr_setsigmask(&attr, &none);                   //the shell keeps SIGCHLD and SIGINT blocked for its signalfd
+    posix_spawnattr_setsigdefault(&attr, &defaults);            //ignored signals would survive the exec
+    posix_spawnattr_setpgroup(&attr, pgid);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+    posix_spawn_file_actions_init(&actions);
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 35)
+    if (ttyFd != -1)
+    {
+        posix_spawn_file_actions_addtcsetpgrp_np(&actions, ttyFd);  //before the program can touch the terminal
+    }
+#endif
+    if (inFd != -1)
+    {
+        posix_spawn_file_actions_adddup2(&actions, inFd, 0);
+    }
+    if (outFd != -1)
+    {
+        posix_spawn_file_actions_adddup2(&actions, outFd, 1);
+    }
+
+    error = posix_spawn(&pid, path, &actions, &attr, stage->argv, environ);
+    if (error == ENOENT && path != stage->argv[0])
+    {
+        pathcache_forget(stage->argv[0]);
+        if ((path = pathcache_lookup(stage->argv[0])) != NULL)
+        {
+            error = posix_spawn(&pid, path, &actions, &attr, stage->argv, environ);
+        }
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    if (error != 0)
+    {
+        errno = error;
+        perror("invalid: Wrong arguments for execvp");
+        return -1;
+    }
+    return pid;
+}
+
+/* Runs a builtin that is one stage of a pipeline in a forked copy
+ * of the shell, without exec. The child exits with the builtin's
+ * status, so cd or export there only affect that stage */
+static pid_t launchBuiltin(const BUILTIN *builtin, STAGE *stage, int inFd, int outFd, pid_t pgid, int ttyFd)
+{
+    pid_t pid = fork();
+
+    if (pid < 0)
+    {
+        perror("invalid: Error in creating child process");
+        return -1;
+    }
+    if (pid == 0)
+    {
+        enter_stage(inFd, outFd, pgid, ttyFd);                  //the shell's job table means nothing here
+        forget_trace();
+        init_events();                                          //a loop of its own, for builtins that start jobs
+        init_jobs();
+        if (launchMode == LAUNCH_ZYGOTE)
+        {
+            launchMode = LAUNCH_SPAWN;                          //the helper's children are the shell's, not ours
+        }
+        shellInput = NULL;                                      //the shell goes on reading its own copy
+        _exit(builtin->run(stage->argc, stage->argv));
+    }
+    setpgid(pid, pgid ? pgid : pid);
+    return pid;
+}
+
+/* Starts one pipeline stage with inFd and outFd (-1 to inherit) as
+ * its standard input and output. Every other descriptor the shell
+ * opens is close-on-exec, so the child needs no explicit closes.
+ * The program is found through the PATH cache; unknown commands
+ * are reported without creating a process at all. The child joins
+ * process group pgid, or leads a new one if it is 0.
+ * Returns the pid, or -1 after reporting an error */
+pid_t launch_stage(STAGE *stage, int inFd, int outFd, pid_t pgid, int ttyFd)
+{
+    const char *path = pathcache_lookup(stage->argv[0]);
+
+    if (path == NULL)
+    {
+        perror("invalid: Wrong arguments for execvp");
+        return -1;
+    }
+    if (launchMode == LAUNCH_FORK)
+    {
+        return launchWithFork(stage, path, inFd, outFd, pgid, ttyFd);
+    }
+    if (launchMode == LAUNCH_ZYGOTE)
+    {
+        pid_t pid = zygote_launch(stage, path, inFd, outFd, pgid, ttyFd);
+
+        if (pid > 0 || errno != EPIPE)
+        {
+            if (pid < 0)
+            {
+                perror("invalid: Error in creating child process");
+            }
+            return pid;
+        }
+        dprintf(STDERR_FILENO, "zygote: launcher helper has gone, using spawn\n");
+        set_launch_mode("spawn");
+    }
+    return launchWithSpawn(stage, path, inFd, outFd, pgid, ttyFd);
+}
+
+/* Writes a stage's here-document or here-string into an anonymous
+ * memory file and returns it sealed and rewound, ready to be the
+ * stage's standard input. The whole body is in place before the
+ * stage starts, so there is no writer to deadlock with and nothing
+ * touches the filesystem. Returns -1 with errno set on failure */
+static int openHere(STAGE *stage)
+{
+    const char *text = stage->here;
+    size_t left = stage->hereLength;
+    ssize_t n;
+    int fd;
+
+    if ((fd = memfd_create("penn-here", MFD_CLOEXEC | MFD_ALLOW_SEALING)) < 0)
+    {
+        return -1;
+    }
+    while (left > 0)
+    {
+        if ((n = write(fd, text, left)) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            close(fd);
+            return -1;
+        }
+        text += n;
+        left -= n;
+    }
+    if ((stage->delimiter == NULL && write(fd, "\n", 1) != 1)   //a here-string gets a newline, as in bash
+        || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0
+        || lseek(fd, 0, SEEK_SET) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Opens the redirection files of one parsed pipeline stage in
+ * the shell. On success *inFd and *outFd are replaced by the files
+ * (which then override any pipe) and 1 is returned. The files are
+ * close-on-exec; the launcher dup2s them onto 0 and 1. On failure
+ * the error is reported, nothing is left open and 0 is returned.
+ */
+int checkRedirection(STAGE *stage, int *inFd, int *outFd){
+    
+    int fdOut=-1,fdIn=-1;       //File descriptors for the input and output redirections
+    
+    if (stage->infile != NULL) {
+        if((fdIn = open(stage->infile, O_RDONLY | O_CLOEXEC)) < 0){                //opens input file and assigns file descriptor
+            perror("invalid standard input redirect");
+            return 0;
+        }
+    }
+    else if (stage->here != NULL) {
+        if((fdIn = openHere(stage)) < 0){                                          //<< and <<< read from memory
+            perror("invalid here-document");
+            return 0;
+        }
+    }
+    
+    if (stage->outfile != NULL) {
+        if((fdOut = open(stage->outfile, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644)) < 0){
+            perror("invalid standard output redirect");                             //it creates if there is no given file, truncates
+            if (fdIn != -1) {                                                       //file content and allowed writeng only
+                close(fdIn);
+            }
+            return 0;
+        }
+    }
+    
+    if (fdIn != -1) {
+        *inFd = fdIn;
+    }
+    if (fdOut != -1) {
+        *outFd = fdOut;
+    }
+    return 1;
+
+}
+
+/* Launches a parsed pipeline of any length as a job without
+ * waiting for it. All stages are started from the shell in one
+ * loop; at most one pipe plus the read end of the previous one are
+ * open at a time. Builtins in a multi-stage or background pipeline
+ * run in a forked shell without exec. With job control every stage
+ * joins one process group, led by the first, so the job can be
+ * signalled with a single kill, and a foreground job is given the
+ * terminal. Without it the stages stay in the shell's group, which
+ * keeps whatever terminal access the shell has. Children are only
+ * reaped from the event loop, so none can be reaped before its pid
+ * is in the job table. The job's status is that of the last stage:
+ * 128+n if it was killed by signal n, 127 if it could not be
+ * started and 1 if its redirections failed. Unless stdoutFd is -1,
+ * the last stage writes to it instead of the shell's standard
+ * output. */
+JOB *checkPipe(COMMAND *command, int stdoutFd){
+
+    int fd[2];                  //pipe between this stage and the next
+    int prevRead = -1;          //read end of the pipe from the previous stage
+    int inFd, outFd;            //what the stage gets as standard input and output
+    int last;                   //1 for the last stage
+    int redirected;             //0 if the stage's redirections failed
+    int ttyFd;                  //terminal the job is given, or -1
+    pid_t shellGroup;           //group the stages join without job control, or 0
+    JOB *job;
+    int i;
+
+    job = create_job(command->line, command->nstages, command->background);
+    ttyFd = !command->background && stdoutFd == -1 ? get_job_terminal() : -1;  //captured output never takes the terminal
+    job->terminal = ttyFd != -1;
+    shellGroup = get_job_terminal() == -1 ? getpgrp() : 0;
+
+    for (i = 0; i < command->nstages; i++) {
+        
+        last = (i == command->nstages - 1);
+        fd[0] = fd[1] = -1;
+        if (!last && pipe2(fd, O_CLOEXEC) < 0) {                //every stage but the last writes into a new pipe
+            perror("Error creating pipe.\n");
+            break;
+        }
+        if (fd[1] != -1 && pipeSize > 0) {                      //fewer wakeups between producer and consumer;
+            fcntl(fd[1], F_SETPIPE_SZ, (int)pipeSize);          //failure just leaves the default size
+        }
+        
+        inFd = prevRead;
+        outFd = last ? stdoutFd : fd[1];
+        job->status = 1;
+        trace_begin("redirect", NULL);
+        redirected = checkRedirection(&command->stages[i], &inFd, &outFd);
+        trace_end("redirect");
+        if (redirected) {                                       //explicit redirections override the pipe
+            
+            STAGE *stage = &command->stages[i];
+            const BUILTIN *builtin = NULL;
+            pid_t pgid = shellGroup ? shellGroup : job->pgid;
+            pid_t pid;
+
+            builtin = find_builtin(stage->argc, stage->argv);
+            if (builtin != NULL && command->nstages == 1 && !command->background && !builtin->job) {
+                builtin = NULL;                                 //builtins only get here when they cannot run in the shell
+            }
+            trace_begin("spawn", stage->argv[0]);
+            pid = builtin != NULL ? launchBuiltin(builtin, stage, inFd, outFd, pgid, ttyFd)
+                                  : launch_stage(stage, inFd, outFd, pgid, ttyFd);
+            trace_end("spawn");
+            if (pid > 0) {
+                add_job_pid(job, pid, stage->argv[0], last);    //with job control the first pid becomes the job's pgid
+                if (ttyFd != -1 && job->npids == 1) {
+                    tcsetpgrp(ttyFd, job->pgid);                //the child does it too; whichever runs first wins
+                }
+                job->status = 0;
+            }
+            else {
+                job->status = 127;
+            }
+            
+            if (inFd != prevRead) {                             //the redirection files belong to the child now
+                close(inFd);
+            }
+            if (outFd != fd[1] && outFd != stdoutFd) {
+                close(outFd);
+            }
+        }
+        
+        if (prevRead != -1) {                                   //the shell keeps no pipe ends it does not need
+            close(prevRead);
+        }
+        if (fd[1] != -1) {
+            close(fd[1]);
+        }
+        prevRead = fd[0];
+    }
+    
+    if (prevRead != -1) {
+        close(prevRead);
+    }
+    return job;
+}
@@ -0,0 +1,144 @@
+#ifndef __LAUNCH_H__
+#define __LAUNCH_H__
+
+
+#include <sys/types.h>
+#include "parser.h"
+#include "jobs.h"
+
+
+
+/**
+ * How pipeline stages are turned into processes.
+ */
+typedef enum launch_mode {
+  LAUNCH_FORK,			/* fork, dup2 in the child, execvp */
+  LAUNCH_SPAWN,			/* posix_spawnp with file actions */
+  LAUNCH_ZYGOTE			/* ask a pre-forked helper, see zygote.h */
+} LAUNCH_MODE;
+
+
+
+/**
+ * Selects how stages are launched.  Choosing "zygote" starts the
+ * launcher helper if it is not running; leaving it stops the helper.
+ *
+ * @param name "fork", "spawn" or "zygote"
+ * @return 1 on success, 0 if the name is unknown
+ */
+int set_launch_mode( const char *name );
+
+
+
+/**
+ * Returns the name of the current launch mode.
+ */
+const char *get_launch_mode( void );
+
+
+
+/**
+ * Sets the buffer size requested for every pipe between pipeline
+ * stages.  Requests above /proc/sys/fs/pipe-max-size are clamped to
+ * it.
+ *
+ * @param bytes requested size, or 0 for the kernel default
+ * @return the size that will be requested
+ */
+long set_pipe_size( long bytes );
+
+
+
+/**
+ * Returns the pipe buffer size being requested, 0 for the default.
+ */
+long get_pipe_size( void );
+
+
+
+/**
+ * Measures the buffer size pipes actually get with the current
+ * setting, which the kernel rounds up to a power-of-two number of
+ * pages and may refuse once a user has too much pipe memory.
+ *
+ * @return the effective size in bytes, or -1 on error
+ */
+long get_effective_pipe_size( void );
+
+
+
+/**
+ * Starts one pipeline stage.  Errors are reported on standard error.
+ *
+ * @param stage the stage to run; only its argv is used, redirections
+ *              must already have been turned into inFd and outFd
+ * @param inFd descriptor to become the stage's standard input, or -1
+ *             to inherit the shell's
+ * @param outFd descriptor to become the stage's standard output, or
+ *              -1 to inherit the shell's
+ * @param pgid process group to join, or 0 to lead a new one
+ * @param ttyFd the terminal to make the group the foreground of, or -1
+ * @return the pid of the new process, or -1 if it could not be started
+ */
+pid_t launch_stage( STAGE *stage, int inFd, int outFd, pid_t pgid, int ttyFd );
+
+
+
+/**
+ * Sets up a freshly forked or cloned child to become a stage.  It
+ * joins its job's process group, takes the terminal while every
+ * signal is blocked, and puts the signals the shell handles itself
+ * back to their default action.  Then it moves inFd and outFd onto
+ * standard input and output and unblocks every signal.  All the
+ * launchers that create the child themselves share this.
+ *
+ * @param inFd descriptor to become standard input, or -1
+ * @param outFd descriptor to become standard output, or -1
+ * @param pgid process group to join, or 0 to lead a new one
+ * @param ttyFd the terminal to make the group the foreground of, or -1
+ */
+void enter_stage( int inFd, int outFd, pid_t pgid, int ttyFd );
+
+
+
+/**
+ * Replaces a child set up by enter_stage with the program at path.
+ * If a cached path has gone away, ENOENT is written to reportFd, so
+ * the parent can drop the entry, and the PATH search is done again
+ * with execvp.  Never returns.
+ *
+ * @param path the program, as found by pathcache_lookup
+ * @param argv the stage's argument vector
+ * @param reportFd close-on-exec descriptor read by the parent, or -1
+ */
+void exec_stage( const char *path, char **argv, int reportFd ) __attribute__((noreturn));
+
+
+
+/**
+ * Opens the < and > files of a stage, or puts its << or <<< text in
+ * a sealed memfd.  On success the descriptors replace *inFd and
+ * *outFd; both are close-on-exec.
+ *
+ * @param stage the stage whose redirections to open
+ * @param inFd standard input the stage would otherwise get
+ * @param outFd standard output the stage would otherwise get
+ * @return 1 on success, 0 after reporting an error
+ */
+int checkRedirection( STAGE *stage, int *inFd, int *outFd );
+
+
+
+/**
+ * Launches every stage of a pipeline as one job, connected by pipes,
+ * without waiting for it.
+ *
+ * @param command the parsed command
+ * @param stdoutFd standard output for the last stage, or -1 for the
+ *                 shell's own
+ * @return the job, already in the job table
+ */
+JOB *checkPipe( COMMAND *command, int stdoutFd );
+
+
+#endif
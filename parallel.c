@@ -0,0 +1,259 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include "parallel.h"
+#include "arena.h"
+#include "parser.h"
+#include "expand.h"
+#include "reader.h"
+#include "launch.h"
+#include "jobs.h"
+#include "events.h"
+#include "builtins.h"
+
+/* A running job and the anonymous file its output goes to */
+typedef struct parallel_slot {
+    JOB *job;                   //NULL if the slot is free
+    int outFd;                  //memfd holding the job's standard output
+} PARALLEL_SLOT;
+
+static char devNull[] = "/dev/null";    //standard input of jobs that name none
+
+/* Copies a finished job's buffered output to standard output in one go */
+static void flushOutput(int fd)
+{
+    off_t offset = 0;
+    off_t size = lseek(fd, 0, SEEK_END);
+    char buf[65536];
+    ssize_t n;
+
+    while (offset < size)
+    {
+        n = sendfile(STDOUT_FILENO, fd, &offset, size - offset);
+        if (n > 0)
+        {
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        break;                                              //sendfile not supported here: fall back below
+    }
+    while (offset < size && (n = pread(fd, buf, sizeof(buf), offset)) > 0)
+    {
+        if (write(STDOUT_FILENO, buf, n) != n)
+        {
+            break;
+        }
+        offset += n;
+    }
+}
+
+/* Parses one line and launches it with its output going to a fresh
+ * memfd. Returns 0 if the line could not be started */
+static int startJob(PARALLEL_SLOT *slot, ARENA *arena, char *line)
+{
+    COMMAND parsed, command;
+    const char *error = parse_command(arena, line, &parsed);
+
+    if (error == NULL && parsed.heredocs > 0)
+    {
+        error = "invalid: here-documents need the lines after them";   //every line here is a job of its own
+    }
+    if (error == NULL && parsed.nstages > 0)
+    {
+        error = expand_command(arena, &parsed, &command);
+    }
+    if (error != NULL)
+    {
+        if (*error != '\0')
+        {
+            dprintf(STDERR_FILENO, "parallel: %s: %s\n", line, error);
+        }
+        return 0;
+    }
+    if (parsed.nstages == 0 || command.stages[0].argc == 0)
+    {
+        return 1;                                           //blank lines are not jobs
+    }
+    command.background = 0;                                 //the builtin waits for it itself
+    if (command.stages[0].infile == NULL && command.stages[0].here == NULL)
+    {
+        command.stages[0].infile = devNull;                 //never the terminal, which it could stop on, nor our input
+    }
+
+    if ((slot->outFd = memfd_create("penn-parallel", MFD_CLOEXEC)) < 0)
+    {
+        perror("parallel: memfd_create");
+        return 0;
+    }
+    slot->job = checkPipe(&command, slot->outFd);
+    return 1;
+}
+
+/* Writes out and releases a finished job. Returns its exit status */
+static int finishJob(PARALLEL_SLOT *slot)
+{
+    int status = wait_job(slot->job);                       //already reaped, so this does not block
+
+    flushOutput(slot->outFd);
+    close(slot->outFd);
+    slot->job = NULL;
+    return status;
+}
+
+/* parallel [-j N] [file]: runs one command per input line, N at a
+ * time. Slots are refilled as the event loop reaps children; in
+ * between the shell sleeps in epoll_wait rather than polling */
+int run_parallel(int argc, char **argv)
+{
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    PARALLEL_SLOT *slots;
+    LINE_READER fileReader;
+    LINE_READER *reader = &fileReader;
+    ARENA arena;
+    char *line = NULL;
+    int inFd = STDIN_FILENO;
+    int running = 0;
+    int failed = 0;
+    int more = 1;
+    int i;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc)
+        {
+            jobs = atol(argv[++i]);
+        }
+        else if (!strncmp(argv[i], "-j", 2) && argv[i][2] != '\0')
+        {
+            jobs = atol(argv[i] + 2);
+        }
+        else
+        {
+            dprintf(STDERR_FILENO, "usage: parallel [-j N] [file]\n");
+            return 2;
+        }
+    }
+    if (jobs < 1)
+    {
+        jobs = 1;
+    }
+    if (i < argc && (inFd = open(argv[i], O_RDONLY | O_CLOEXEC)) < 0)
+    {
+        dprintf(STDERR_FILENO, "parallel: %s: %s\n", argv[i], strerror(errno));
+        return 1;
+    }
+
+    slots = calloc(jobs, sizeof(PARALLEL_SLOT));
+    if (slots == NULL)
+    {
+        perror("parallel");
+        return 1;
+    }
+    if (inFd == STDIN_FILENO && shellInput != NULL)
+    {
+        reader = shellInput;                                //it may hold lines already read past the command
+    }
+    else
+    {
+        init_line_reader(&fileReader, inFd);
+    }
+    init_arena(&arena);
+
+    while (more || running > 0)
+    {
+        if (interrupted)
+        {
+            more = 0;                                       //^C: the shell signalled the running jobs already
+        }
+        for (i = 0; i < jobs && more; i++)                  //fills every free slot
+        {
+            if (slots[i].job != NULL)
+            {
+                continue;
+            }
+            if ((line = read_line(reader, NULL)) == NULL)
+            {
+                more = 0;
+                break;
+            }
+            if (!startJob(&slots[i], &arena, line))
+            {
+                failed++;
+            }
+            else if (slots[i].job != NULL)
+            {
+                running++;
+            }
+            arena_reset(&arena);                            //the job keeps nothing from the parse
+        }
+
+        while (running > 0)                                 //sleeps until a slot frees up, or all do at the end
+        {
+            int done = 0;
+
+            for (i = 0; i < jobs; i++)
+            {
+                if (slots[i].job != NULL && slots[i].job->remaining == 0)
+                {
+                    if (finishJob(&slots[i]) != 0)
+                    {
+                        failed++;
+                    }
+                    running--;
+                    done++;
+                }
+            }
+            if (done > 0 && more)
+            {
+                break;
+            }
+            if (done == 0 && wait_for_event(-1) < 0)
+            {
+                more = 0;                                   //the event loop failed: give up on the rest
+                running = 0;
+                failed++;
+            }
+        }
+    }
+
+    for (i = 0; i < jobs; i++)
+    {
+        if (slots[i].job != NULL)
+        {
+            close(slots[i].outFd);                          //only left after a failure, still running
+        }
+    }
+    free_arena(&arena);
+    if (reader == &fileReader)
+    {
+        free_line_reader(&fileReader);
+    }
+    else if (isatty(STDIN_FILENO))
+    {
+        reader->eof = 0;                                    //^D at a terminal only ends this command's input
+    }
+    free(slots);
+    if (inFd != STDIN_FILENO)
+    {
+        close(inFd);
+    }
+    if (interrupted)
+    {
+        if (isatty(STDIN_FILENO))
+        {
+            write(STDOUT_FILENO, "\n", 1);                  //the terminal echoed ^C mid-line
+        }
+        return 128 + SIGINT;
+    }
+    return failed ? 1 : 0;
+}
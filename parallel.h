@@ -0,0 +1,25 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+
+
+/**
+ * The parallel builtin: parallel [-j N] [file]
+ *
+ * Reads one command line per line from file, or from standard input,
+ * and runs them with at most N in flight (default: one per online
+ * CPU).  Each job's standard output is collected in memory and
+ * written out in one piece when it finishes, so the outputs of
+ * different jobs never interleave.  Jobs without a < of their own
+ * read /dev/null.  ^C stops it starting new jobs;
+ * the running ones get the SIGINT from the shell.
+ *
+ * @param argc number of arguments
+ * @param argv the arguments, starting with "parallel"
+ * @return 0 if every job succeeded, 128 + SIGINT if interrupted,
+ *         1 otherwise
+ */
+int run_parallel( int argc, char **argv );
+
+
+#endif
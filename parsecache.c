@@ -0,0 +1,269 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "parsecache.h"
+#include "hash.h"
+
+#define PARSECACHE_ENTRIES 64   //lines remembered; the least recently used one goes first
+#define PARSECACHE_BUCKETS 128  //a power of two, at least twice the entries
+
+typedef struct parse_entry {
+    struct parse_entry *next;   //next entry in the same bucket
+    struct parse_entry *newer;  //LRU list, most recently used at the head
+    struct parse_entry *older;
+    uint64_t hash;              //hash of line
+    size_t length;              //length of line
+    const char *error;          //parse error, or NULL
+    COMMAND command;            //the parsed line; everything it points to lives in block
+    int pins;                   //commands handed out and not yet released
+    char *block;                //one allocation for stages, argv and strings
+    char line[];                //the raw line
+} PARSE_ENTRY;
+
+static PARSE_ENTRY *buckets[PARSECACHE_BUCKETS];
+static PARSE_ENTRY *newest = NULL, *oldest = NULL;
+static int entryCount = 0;
+static unsigned long hits = 0, misses = 0;
+
+/* Takes an entry out of the LRU list */
+static void unlinkLru(PARSE_ENTRY *entry)
+{
+    if (entry->newer != NULL)
+    {
+        entry->newer->older = entry->older;
+    }
+    else
+    {
+        newest = entry->older;
+    }
+    if (entry->older != NULL)
+    {
+        entry->older->newer = entry->newer;
+    }
+    else
+    {
+        oldest = entry->newer;
+    }
+}
+
+/* Puts an entry at the most recently used end */
+static void pushNewest(PARSE_ENTRY *entry)
+{
+    entry->newer = NULL;
+    entry->older = newest;
+    if (newest != NULL)
+    {
+        newest->newer = entry;
+    }
+    newest = entry;
+    if (oldest == NULL)
+    {
+        oldest = entry;
+    }
+}
+
+/* Unlinks and frees an entry */
+static void removeEntry(PARSE_ENTRY *entry)
+{
+    PARSE_ENTRY **link = &buckets[entry->hash & (PARSECACHE_BUCKETS - 1)];
+
+    while (*link != entry)
+    {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+    unlinkLru(entry);
+    free(entry->block);
+    free(entry);
+    entryCount--;
+}
+
+/* Copies a string into the block, advancing the cursor */
+static char *copyString(char **cursor, const char *text)
+{
+    char *copy = *cursor;
+
+    if (text == NULL)
+    {
+        return NULL;
+    }
+    *cursor = stpcpy(copy, text) + 1;
+    return copy;
+}
+
+/* Deep-copies a parsed command into one malloc'd block: the stage
+ * array, then every argv array, then every string */
+static char *copyCommand(const COMMAND *from, COMMAND *to)
+{
+    size_t pointers = 0, bytes = 0;
+    char **argv;
+    char *block, *cursor;
+    int i, k;
+
+    for (i = 0; i < from->nstages; i++)
+    {
+        const STAGE *stage = &from->stages[i];
+
+        pointers += stage->argc + 1;
+        for (k = 0; k < stage->argc; k++)
+        {
+            bytes += strlen(stage->argv[k]) + 1;
+        }
+        bytes += stage->infile != NULL ? strlen(stage->infile) + 1 : 0;
+        bytes += stage->outfile != NULL ? strlen(stage->outfile) + 1 : 0;
+        bytes += stage->here != NULL ? stage->hereLength + 1 : 0;
+    }
+    block = malloc(from->nstages * sizeof(STAGE) + pointers * sizeof(char *) + bytes + 1);
+    if (block == NULL)
+    {
+        return NULL;
+    }
+
+    *to = *from;
+    to->stages = (STAGE *)block;
+    argv = (char **)(block + from->nstages * sizeof(STAGE));
+    cursor = (char *)(argv + pointers);
+    for (i = 0; i < from->nstages; i++)
+    {
+        const STAGE *stage = &from->stages[i];
+        STAGE *copy = &to->stages[i];
+
+        copy->argc = stage->argc;
+        copy->argv = argv;
+        for (k = 0; k < stage->argc; k++)
+        {
+            argv[k] = copyString(&cursor, stage->argv[k]);
+        }
+        argv[k] = NULL;
+        argv += stage->argc + 1;
+        copy->infile = copyString(&cursor, stage->infile);
+        copy->outfile = copyString(&cursor, stage->outfile);
+        copy->here = copyString(&cursor, stage->here);     //only here-strings; << lines are never cached
+        copy->hereLength = stage->hereLength;
+        copy->delimiter = NULL;
+    }
+    return block;
+}
+
+/* Frees the least recently used unpinned entry. Returns 0 if every
+ * entry is pinned */
+static int evictOne(void)
+{
+    PARSE_ENTRY *entry;
+
+    for (entry = oldest; entry != NULL; entry = entry->newer)
+    {
+        if (entry->pins == 0)
+        {
+            removeEntry(entry);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Remembers a freshly parsed line */
+static void insertEntry(const char *line, size_t length, uint64_t hash,
+                        const char *error, const COMMAND *command)
+{
+    PARSE_ENTRY *entry;
+
+    if (error == NULL && command->heredocs > 0)
+    {
+        return;                                             //the body on the next lines is part of the command
+    }
+    if (entryCount >= PARSECACHE_ENTRIES && !evictOne())
+    {
+        return;                                             //everything is in use; just don't cache
+    }
+    if ((entry = malloc(sizeof(PARSE_ENTRY) + length + 1)) == NULL)
+    {
+        return;
+    }
+    memset(entry, 0, sizeof(PARSE_ENTRY));
+    if (error == NULL && (entry->block = copyCommand(command, &entry->command)) == NULL)
+    {
+        free(entry);
+        return;
+    }
+    memcpy(entry->line, line, length + 1);
+    entry->length = length;
+    entry->hash = hash;
+    entry->error = error;                                   //parse errors are static strings
+    entry->next = buckets[hash & (PARSECACHE_BUCKETS - 1)];
+    buckets[hash & (PARSECACHE_BUCKETS - 1)] = entry;
+    pushNewest(entry);
+    entryCount++;
+}
+
+/* Answers a line from the cache, or parses and remembers it */
+const char *parse_cached(ARENA *arena, char *line, COMMAND *command)
+{
+    PARSE_ENTRY *entry;
+    const char *error;
+    uint64_t hash;
+    size_t length;
+
+    hash = fnv1a(line, &length);
+    for (entry = buckets[hash & (PARSECACHE_BUCKETS - 1)]; entry != NULL; entry = entry->next)
+    {
+        if (entry->hash == hash && entry->length == length && memcmp(entry->line, line, length) == 0)
+        {
+            hits++;
+            unlinkLru(entry);
+            pushNewest(entry);
+            if (entry->error != NULL)
+            {
+                command->cache = NULL;
+                return entry->error;
+            }
+            *command = entry->command;
+            command->line = line;                           //the caller's copy; the job text comes from it
+            command->cache = entry;
+            entry->pins++;
+            return NULL;
+        }
+    }
+
+    misses++;
+    error = parse_command(arena, line, command);
+    insertEntry(line, length, hash, error, command);
+    return error;
+}
+
+/* Unpins the entry a command came from */
+void release_parse(COMMAND *command)
+{
+    if (command->cache != NULL)
+    {
+        ((PARSE_ENTRY *)command->cache)->pins--;
+        command->cache = NULL;
+    }
+}
+
+/* Drops every unpinned entry */
+void parsecache_clear(void)
+{
+    PARSE_ENTRY *entry = oldest;
+
+    while (entry != NULL)
+    {
+        PARSE_ENTRY *newer = entry->newer;
+
+        if (entry->pins == 0)
+        {
+            removeEntry(entry);
+        }
+        entry = newer;
+    }
+}
+
+/* Prints the counters */
+void parsecache_print(int fd)
+{
+    unsigned long lookups = hits + misses;
+
+    dprintf(fd, "hits\t%lu\nmisses\t%lu\nhit rate\t%.1f%%\nentries\t%d/%d\n", hits, misses,
+            lookups ? 100.0 * hits / lookups : 0.0, entryCount, PARSECACHE_ENTRIES);
+}
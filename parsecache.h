@@ -0,0 +1,52 @@
+#ifndef __PARSECACHE_H__
+#define __PARSECACHE_H__
+
+
+#include "arena.h"
+#include "parser.h"
+
+
+
+/**
+ * Parses a command line like parse_command, but remembers the
+ * validated result of the most recently used lines.  A line seen
+ * before is not tokenized again: the command is filled in straight
+ * from the cache, and the entry is pinned until release_parse is
+ * called for it.  Its stages, argv and redirection targets belong to
+ * the cache and must not be modified; only the COMMAND itself is the
+ * caller's.
+ *
+ * @param arena the arena a line that is not cached is parsed into
+ * @param line the command line.  Should be non-NULL.
+ * @param command filled in with the parsed command on success
+ * @return NULL on success, otherwise a message describing the error.
+ */
+const char *parse_cached( ARENA *arena, char *line, COMMAND *command );
+
+
+
+/**
+ * Unpins the cache entry a command was filled in from, if any.  Must
+ * be called once the command has been run and before its COMMAND is
+ * reused.
+ * @param command a command filled in by parse_cached
+ */
+void release_parse( COMMAND *command );
+
+
+
+/**
+ * Drops every cached line that is not pinned.
+ */
+void parsecache_clear( void );
+
+
+
+/**
+ * Writes the cache's hit and miss counts and occupancy.
+ * @param fd where to write
+ */
+void parsecache_print( int fd );
+
+
+#endif
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "parser.h"
+
+
+/* appends a word to a stage's argv, growing it geometrically */
+static void push_arg( ARENA *arena, STAGE *stage, int *capacity, char *word )
+{
+  if( stage->argc + 1 >= *capacity ) {
+    char **argv;
+
+    *capacity = *capacity ? *capacity * 2 : 8;
+    argv = (char **)arena_alloc( arena, *capacity * sizeof(char *) );
+    if( stage->argc > 0 )
+      memcpy( argv, stage->argv, stage->argc * sizeof(char *) );
+    stage->argv = argv;
+  }
+  stage->argv[stage->argc++] = word;
+  stage->argv[stage->argc] = NULL;
+}
+
+
+
+/* copies a span out of the line into a null-terminated string */
+static char *copy_span( ARENA *arena, TOKENIZER *tokenizer, TOKEN_SPAN *span )
+{
+  return arena_strndup( arena, tokenizer->str + span->offset, span->length );
+}
+
+
+
+/* 1 if every $( in a word has its closing ) */
+static int substitutions_closed( const char *word )
+{
+  while( (word = strstr( word, "$(" )) != NULL )
+    if( (word = skip_substitution( word )) == NULL )
+      return 0;
+  return 1;
+}
+
+
+
+/* appends an empty stage to the command, growing it geometrically */
+static STAGE *push_stage( ARENA *arena, COMMAND *command, int *capacity )
+{
+  STAGE *stage;
+
+  if( command->nstages == *capacity ) {
+    STAGE *stages;
+
+    *capacity = *capacity ? *capacity * 2 : 4;
+    stages = (STAGE *)arena_alloc( arena, *capacity * sizeof(STAGE) );
+    if( command->nstages > 0 )
+      memcpy( stages, command->stages, command->nstages * sizeof(STAGE) );
+    command->stages = stages;
+  }
+  stage = &command->stages[command->nstages++];
+  memset( stage, 0, sizeof(STAGE) );
+  return stage;
+}
+
+
+
+/**
+ * Parses a command line in a single pass over its tokens and
+ * validates its redirections and pipes.
+ *
+ * @param arena the arena the parsed command is allocated from
+ * @param line the command line.  Should be non-NULL.
+ * @param command filled in with the parsed command on success
+ * @return NULL on success, otherwise a message describing the error.
+ */
+const char *parse_command( ARENA *arena, char *line, COMMAND *command )
+{
+  TOKENIZER tokenizer;
+  TOKEN_SPAN span;
+  STAGE *stage = NULL;
+  int stageCapacity = 0;
+  int argCapacity = 0;
+  int inputs = 0, outputs = 0, pipes = 0;
+  const char *error = NULL;
+  int i;
+
+  assert( line != NULL );
+  assert( command != NULL );
+  command->stages = NULL;
+  command->nstages = 0;
+  command->background = 0;
+  command->line = line;
+  command->cache = NULL;
+  command->heredocs = 0;
+
+  init_span_tokenizer( &tokenizer, line );
+  while( error == NULL && get_next_span( &tokenizer, &span ) ) {
+    if( command->background ) {
+      error = "invalid: & must end the command";
+      break;
+    }
+    if( span.kind == TOKEN_AMP ) {
+      if( stage == NULL )	/* nothing, or a | right before it */
+	error = "invalid: & must follow a command";
+      command->background = 1;
+      continue;
+    }
+    if( stage == NULL ) {
+      stage = push_stage( arena, command, &stageCapacity );
+      argCapacity = 0;
+    }
+
+    switch( span.kind ) {
+    case TOKEN_PIPE:
+      if( stage->argc == 0 )
+	error = "invalid pipeline";
+      pipes++;
+      stage = NULL;		/* next token starts a new stage */
+      break;
+
+    case TOKEN_LESS:
+    case TOKEN_HEREDOC:
+    case TOKEN_HERESTRING:
+    case TOKEN_GREATER: {
+      TOKEN_SPAN target;
+      int input = (span.kind != TOKEN_GREATER);
+
+      if( input ? ++inputs > 1 : ++outputs > 1 ) {
+	error = input ? "invalid input redirection"
+	              : "invalid output redirection";
+	break;
+      }
+      if( !get_next_span( &tokenizer, &target ) || target.kind != TOKEN_WORD ) {
+	error = input ? "invalid standard input redirect"
+	              : "invalid standard output redirect";
+	break;
+      }
+      if( span.kind == TOKEN_HEREDOC ) {
+	stage->delimiter = copy_span( arena, &tokenizer, &target );
+	command->heredocs++;	/* its body is on the lines after */
+      }
+      else if( span.kind == TOKEN_HERESTRING ) {
+	stage->here = copy_span( arena, &tokenizer, &target );
+	stage->hereLength = target.length;
+      }
+      else if( input )
+	stage->infile = copy_span( arena, &tokenizer, &target );
+      else
+	stage->outfile = copy_span( arena, &tokenizer, &target );
+      break;
+    }
+
+    default:
+      push_arg( arena, stage, &argCapacity, copy_span( arena, &tokenizer, &span ) );
+      break;
+    }
+  }
+
+  if( error == NULL && pipes > 0 && stage == NULL )
+    error = "invalid pipeline";	/* trailing | */
+  for( i = 0; error == NULL && i < command->nstages; i++ ) {
+    STAGE *checked = &command->stages[i];
+    int k;
+
+    if( checked->argc == 0 )
+      error = "invalid: missing command";
+    else if( i > 0 && (checked->infile != NULL || checked->here != NULL || checked->delimiter != NULL) )
+      error = "invalid standard input redirect";
+    else if( i < command->nstages - 1 && checked->outfile != NULL )
+      error = "invalid standard output redirect";
+    for( k = 0; error == NULL && k < checked->argc; k++ )
+      if( !substitutions_closed( checked->argv[k] ) )
+	error = "invalid: unterminated command substitution";
+    if( error == NULL && ((checked->infile != NULL && !substitutions_closed( checked->infile ))
+			  || (checked->outfile != NULL && !substitutions_closed( checked->outfile ))
+			  || (checked->here != NULL && !substitutions_closed( checked->here ))) )
+      error = "invalid: unterminated command substitution";
+  }
+
+  return error;
+}
+
+
+
+
+/**
+ * Finds the stage whose << body is still to be read.
+ *
+ * @param command a parsed command
+ * @return the stage, or NULL once every body has been read
+ */
+STAGE *next_heredoc( COMMAND *command )
+{
+  int i;
+
+  for( i = 0; command->heredocs > 0 && i < command->nstages; i++ )
+    if( command->stages[i].delimiter != NULL && command->stages[i].here == NULL )
+      return &command->stages[i];
+  return NULL;
+}
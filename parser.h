@@ -0,0 +1,69 @@
+#ifndef __PARSER_H__
+#define __PARSER_H__
+
+
+#include "tokenizer.h"
+#include "arena.h"
+
+
+
+/**
+ * One stage of a pipeline: the argument vector for execvp plus the
+ * files its standard input and output are redirected to, if any.
+ */
+typedef struct stage {
+  char **argv;			/* NULL-terminated argument vector */
+  int argc;			/* number of entries in argv */
+  char *infile;			/* target of <, or NULL */
+  char *outfile;		/* target of >, or NULL */
+  const char *here;		/* standard input given inline by <<< or <<, or NULL */
+  size_t hereLength;		/* length of here */
+  char *delimiter;		/* word ending the << body, or NULL for <<< */
+} STAGE;
+
+
+
+/**
+ * A fully parsed and validated command line.
+ */
+typedef struct command {
+  STAGE *stages;		/* pipeline stages, left to right */
+  int nstages;			/* number of stages; 0 for a blank line */
+  int background;		/* 1 if the line ended with & */
+  const char *line;		/* the line that was parsed */
+  void *cache;			/* parse cache entry it came from, or NULL */
+  int heredocs;			/* 1 while a << body is still to be read
+				   from the lines after, else 0 */
+} COMMAND;
+
+
+
+/**
+ * Parses a command line in a single pass over its tokens and
+ * validates its redirections and pipes.  Every string and vector in
+ * the result lives in the arena, so the whole command is released
+ * by resetting it.
+ *
+ * @param arena the arena the parsed command is allocated from
+ * @param line the command line.  Should be non-NULL.
+ * @param command filled in with the parsed command on success
+ * @return NULL on success, otherwise a message describing the error.
+ */
+const char *parse_command( ARENA *arena, char *line, COMMAND *command );
+
+
+
+/**
+ * Finds the stage whose << body is still to be read.  Only the first
+ * stage may redirect its input, once, so a line holds at most one
+ * here-document; its body follows the line, ended by a line holding
+ * just the delimiter.  Whoever reads the lines sets the stage's here
+ * and hereLength and decrements the command's heredocs.
+ *
+ * @param command a parsed command
+ * @return the stage, or NULL once every body has been read
+ */
+STAGE *next_heredoc( COMMAND *command );
+
+
+#endif
@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "pathcache.h"
+#include "hash.h"
+
+#define PATHCACHE_MIN_BUCKETS 64
+
+typedef struct path_entry {
+    struct path_entry *next;    //next entry in the same bucket
+    uint64_t hash;              //hash of name
+    unsigned hits;              //lookups answered from the cache
+    char *path;                 //resolved absolute path
+    char name[];                //command name
+} PATH_ENTRY;
+
+static PATH_ENTRY **buckets = NULL;     //chained hash table
+static size_t bucketCount = 0;          //always a power of two
+static size_t entryCount = 0;
+static char *cachedPath = NULL;         //value of $PATH the table was built for
+
+/* Doubles the bucket array once the table is fuller than one entry per bucket */
+static void growTable(void)
+{
+    size_t newCount = bucketCount ? bucketCount * 2 : PATHCACHE_MIN_BUCKETS;
+    PATH_ENTRY **newBuckets = calloc(newCount, sizeof(PATH_ENTRY *));
+    size_t i;
+
+    if (newBuckets == NULL)
+    {
+        return;                                             //keep the old, fuller table
+    }
+    for (i = 0; i < bucketCount; i++)
+    {
+        while (buckets[i] != NULL)
+        {
+            PATH_ENTRY *entry = buckets[i];
+            buckets[i] = entry->next;
+            entry->next = newBuckets[entry->hash & (newCount - 1)];
+            newBuckets[entry->hash & (newCount - 1)] = entry;
+        }
+    }
+    free(buckets);
+    buckets = newBuckets;
+    bucketCount = newCount;
+}
+
+/* Drops every cached path */
+void pathcache_clear(void)
+{
+    size_t i;
+
+    for (i = 0; i < bucketCount; i++)
+    {
+        while (buckets[i] != NULL)
+        {
+            PATH_ENTRY *entry = buckets[i];
+            buckets[i] = entry->next;
+            free(entry->path);
+            free(entry);
+        }
+    }
+    entryCount = 0;
+}
+
+/* Drops the table if $PATH changed since it was filled */
+static void checkPathChanged(void)
+{
+    const char *path = getenv("PATH");
+
+    if (path == NULL)
+    {
+        path = "";
+    }
+    if (cachedPath != NULL && !strcmp(cachedPath, path))
+    {
+        return;
+    }
+    pathcache_clear();
+    free(cachedPath);
+    cachedPath = strdup(path);
+}
+
+/* Walks $PATH the way execvp does and returns a malloc'd path to the
+ * first regular executable file called name, or NULL */
+static char *searchPath(const char *name)
+{
+    const char *dir = cachedPath;
+    size_t nameLen = strlen(name);
+    int error = ENOENT;
+
+    for (;;)
+    {
+        const char *end = strchrnul(dir, ':');
+        size_t dirLen = end - dir;
+        char *candidate = malloc(dirLen + nameLen + 3);
+        struct stat st;
+
+        if (dirLen == 0)
+        {
+            candidate[0] = '.';                             //an empty entry means the current directory
+            dirLen = 1;
+        }
+        else
+        {
+            memcpy(candidate, dir, dirLen);
+        }
+        candidate[dirLen] = '/';
+        memcpy(candidate + dirLen + 1, name, nameLen + 1);
+
+        if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode))
+        {
+            if (access(candidate, X_OK) == 0)
+            {
+                return candidate;
+            }
+            error = EACCES;
+        }
+        free(candidate);
+
+        if (*end == '\0')
+        {
+            break;
+        }
+        dir = end + 1;
+    }
+    errno = error;
+    return NULL;
+}
+
+/* Resolves a command name to the path execvp would run, using and
+ * filling the cache. Returns NULL with errno set if not found */
+const char *pathcache_lookup(const char *name)
+{
+    uint64_t hash;
+    PATH_ENTRY *entry;
+    char *path;
+
+    if (strchr(name, '/') != NULL)
+    {
+        return name;                                        //explicit paths bypass $PATH entirely
+    }
+    checkPathChanged();
+
+    hash = fnv1a(name, NULL);
+    if (bucketCount > 0)
+    {
+        for (entry = buckets[hash & (bucketCount - 1)]; entry != NULL; entry = entry->next)
+        {
+            if (entry->hash == hash && !strcmp(entry->name, name))
+            {
+                entry->hits++;
+                return entry->path;
+            }
+        }
+    }
+
+    if ((path = searchPath(name)) == NULL)
+    {
+        return NULL;                                        //misses are not cached, the program may appear later
+    }
+
+    if (entryCount >= bucketCount)
+    {
+        growTable();
+    }
+    entry = malloc(sizeof(PATH_ENTRY) + strlen(name) + 1);
+    if (entry == NULL || bucketCount == 0)
+    {
+        free(entry);
+        free(path);
+        errno = ENOMEM;
+        return NULL;
+    }
+    strcpy(entry->name, name);
+    entry->hash = hash;
+    entry->hits = 1;
+    entry->path = path;
+    entry->next = buckets[hash & (bucketCount - 1)];
+    buckets[hash & (bucketCount - 1)] = entry;
+    entryCount++;
+    return entry->path;
+}
+
+/* Drops the cached path for one command */
+void pathcache_forget(const char *name)
+{
+    uint64_t hash = fnv1a(name, NULL);
+    PATH_ENTRY **link;
+
+    if (bucketCount == 0)
+    {
+        return;
+    }
+    for (link = &buckets[hash & (bucketCount - 1)]; *link != NULL; link = &(*link)->next)
+    {
+        if ((*link)->hash == hash && !strcmp((*link)->name, name))
+        {
+            PATH_ENTRY *entry = *link;
+            *link = entry->next;
+            free(entry->path);
+            free(entry);
+            entryCount--;
+            return;
+        }
+    }
+}
+
+/* Writes the table in the format of bash's hash builtin */
+void pathcache_print(int fd)
+{
+    size_t i;
+    PATH_ENTRY *entry;
+
+    if (entryCount == 0)
+    {
+        dprintf(fd, "hash: hash table empty\n");
+        return;
+    }
+    dprintf(fd, "hits\tcommand\n");
+    for (i = 0; i < bucketCount; i++)
+    {
+        for (entry = buckets[i]; entry != NULL; entry = entry->next)
+        {
+            dprintf(fd, "%4u\t%s\n", entry->hits, entry->path);
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef __PATHCACHE_H__
+#define __PATHCACHE_H__
+
+
+
+/**
+ * Resolves a command name to the absolute path of the program that
+ * execvp would run, remembering the answer.  Names containing a '/'
+ * are returned unchanged and never cached.  The whole table is
+ * dropped whenever $PATH differs from the value it was built for.
+ *
+ * @param name the command name (argv[0])
+ * @return the path to exec, or NULL with errno set if no executable
+ *         of that name is on $PATH.  The string belongs to the cache
+ *         and stays valid until the entry is forgotten.
+ */
+const char *pathcache_lookup( const char *name );
+
+
+
+/**
+ * Drops the cached path for one command, e.g. after exec reported
+ * that it no longer exists.
+ * @param name the command name
+ */
+void pathcache_forget( const char *name );
+
+
+
+/**
+ * Drops every cached path.
+ */
+void pathcache_clear( void );
+
+
+
+/**
+ * Writes the cached commands, their paths and hit counts to a file
+ * descriptor in the format of bash's hash builtin.
+ * @param fd where to write
+ */
+void pathcache_print( int fd );
+
+
+#endif
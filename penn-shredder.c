@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -6,33 +7,137 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include "tokenizer.h"
-
-pid_t childPid = 1;
-int killFlag = 0;
-int time = 0;
+#include "parser.h"
+#include "parsecache.h"
+#include "history.h"
+#include "expand.h"
+#include "launch.h"
+#include "pathcache.h"
+#include "builtins.h"
+#include "reader.h"
+#include "jobs.h"
+#include "stats.h"
+#include "trace.h"
+#include "events.h"
+
+int lastStatus = 0;             //exit status of the last command
+int interactive = 0;            //1 if standard input is a terminal
+LINE_READER inputReader;        //buffered reader over standard input
+LINE_READER *shellInput = NULL; //&inputReader while builtins may read it
+ARENA commandArena;             //owns the parsed form of the current line
+int atPrompt = 0;               //1 while waiting for a command line
+char prompt[] = "penn-shredder# ";
 void executeShell();
 
 void writeToStdout(char *text);
 
-void alarmHandler(int sig);
+void writeToStderr(const char *text);
 
 void sigintHandler(int sig);
 
 char *getCommandFromInput();
 
+int readInputHeredocs(COMMAND *command);
+
+const char *recordHistory(char **line);
+
+void openHistory();
+
 void registerSignalHandlers();
 
-int killChildProcess();
+int waitForInput(int fd);
+
+int killChildProcess(int sig);
+
+int runBuiltin(const BUILTIN *builtin, STAGE *stage);
+
+void startCommand(ARENA *arena, COMMAND *command);
+
+int finishCommand();
 
-void checkRedirection(char *command);
+int runCommand(ARENA *arena, COMMAND *command);
 
-int checkPipe(char *command);
+void runScript(char *text, size_t length);
 
+void runScriptFile(const char *path);
+
+/* penn-shredder                  reads commands from standard input
+ * penn-shredder -f script.sh     runs every line of script.sh
+ * penn-shredder -c "command"     runs the given command line(s)
+ * penn-shredder -t seconds ...   kills any job that runs longer */
 int main(int argc, char **argv)
 {
+    char *scriptFile = NULL;
+    char *commandString = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:c:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f':
+            scriptFile = optarg;
+            break;
+        case 'c':
+            commandString = optarg;
+            break;
+        case 't':
+            set_job_timeout(atof(optarg));                      //same as set timeout
+            break;
+        default:
+            writeToStderr("usage: penn-shredder [-t seconds] [-f script | -c command]\n");
+            exit(2);
+        }
+    }
+
+    init_events();
     registerSignalHandlers();
-    
+    init_jobs();
+    init_arena(&commandArena);
+    if (getenv("PENN_LAUNCH") != NULL && !set_launch_mode(getenv("PENN_LAUNCH")))
+    {
+        writeToStderr("invalid PENN_LAUNCH: expected fork, spawn or zygote\n");
+    }
+    if (getenv("PENN_TRACE") != NULL && init_trace(getenv("PENN_TRACE")) < 0)
+    {
+        perror("invalid PENN_TRACE");
+    }
+    if (getenv("PENN_STATSLOG") != NULL && set_stats_log(getenv("PENN_STATSLOG")) < 0)
+    {
+        perror("invalid PENN_STATSLOG");
+    }
+    if (getenv("PENN_PIPE_SIZE") != NULL)
+    {
+        set_pipe_size(atol(getenv("PENN_PIPE_SIZE")));             //same as set pipesize
+    }
+
+    if (scriptFile != NULL)
+    {
+        runScriptFile(scriptFile);
+        exit(lastStatus);
+    }
+    if (commandString != NULL)
+    {
+        runScript(commandString, strlen(commandString));
+        exit(lastStatus);
+    }
+
+    init_line_reader(&inputReader, STDIN_FILENO);
+    inputReader.wait = waitForInput;                                //jobs are reaped and timed out while at the prompt
+    shellInput = &inputReader;
+    interactive = isatty(STDIN_FILENO);
+    if (interactive)
+    {
+        set_job_terminal(STDIN_FILENO);                             //foreground jobs get the terminal while they run
+        openHistory();
+    }
     while (1)
     {
         executeShell();
@@ -41,119 +146,417 @@ int main(int argc, char **argv)
     return 0;
 }
 
-/* Sends SIGKILL signal to a child process.
- * Error checks for kill system call failure and exits program if
- * there is an error */
-int killChildProcess()
+/* Sends a signal to the process group of every job the shell is
+ * waiting for, one kill each. Returns 1 if there was one to signal */
+int killChildProcess(int sig)
+{
+    return signal_jobs(sig) > 0;
+}
+
+//-------------------------1B-------------------------/
+/* Handler for SIGINT (e.g. Ctrl + C). It is read from the event
+ * loop's signalfd rather than interrupting the shell, so it runs
+ * between other work and may do anything. The signal is passed on
+ * to the jobs being waited for, which are in process groups of
+ * their own; at the prompt the line is abandoned and a fresh prompt
+ * shown. A script with nothing running stops. An interactive shell
+ * only sees ^C at the prompt, as the terminal sends it straight to
+ * the foreground job otherwise, or while a builtin such as wait or
+ * a here-document reads; interrupted makes those give up */
+void sigintHandler(int sig)
 {
-    if (kill(childPid, SIGKILL) == -1)
+    if (!atPrompt)
     {
-        return 0;
+        interrupted = 1;
     }
-    else
+    if (killChildProcess(sig))
     {
-        alarm(0);
-        return 1;
+        return;
+    }
+    if (atPrompt && interactive)
+    {
+        writeToStdout("\n");
+        writeToStdout(prompt);
+    }
+    else if (!interactive && foreground_job() == NULL)
+    {
+        exit(128 + sig);
+    }
+}
+
+/* Has SIGINT delivered through the event loop. Children start with
+ * an empty signal mask, so they still get it with its default action */
+void registerSignalHandlers()
+{
+    watch_signal(SIGINT, sigintHandler);
+}
 
+/* Wait hook of the input reader: runs the event loop until standard
+ * input is readable, or gives up once ^C has interrupted a command
+ * still reading its input, such as a here-document */
+int waitForInput(int fd)
+{
+    int ready;
+
+    while ((ready = wait_for_event(fd)) == 0)
+    {
+        if (interrupted)
+        {
+            return 0;
+        }
     }
+    return ready > 0;
 }
 
-//-------------------------1B-------------------------/
-/* Signal handler for SIGALRM. Catches SIGALRM signal and
- * kills the child process if it exists and is still executing.
- * It then prints out penn-shredder's catchphrase to standard output */
-void alarmHandler(int sig)
+/* Prints the shell prompt and waits for input from user.
+ * The line is parsed once in the shell; syntax errors are reported
+ * without forking. A valid command is handed to runCommand. */
+void executeShell()
 {
-    if (childPid != 0)
+    char *command;
+
+    reap_finished_jobs(interactive ? STDERR_FILENO : -1);           //reports background jobs that have finished
+    interrupted = 0;                                                //a ^C before now is done with
+    if (interactive)
+    {
+        writeToStdout(prompt);                                      //scripts and pipes get no prompt
+    }
+
+    atPrompt = 1;
+    command = getCommandFromInput();
+    atPrompt = 0;
+
+    if (command != NULL)
     {
-        killFlag = 1;
-        if (killChildProcess())
+        COMMAND parsed;
+        const char *error;
+
+        if (interactive && (error = recordHistory(&command)) != NULL)
+        {
+            writeToStderr(error);
+            writeToStderr("\n");
+            arena_reset(&commandArena);
+            return;
+        }
+
+        trace_begin("parse", command);
+        error = parse_cached(&commandArena, command, &parsed);        //tokenizes and validates the line once
+        trace_end("parse");
+
+        if (error != NULL)
+        {
+            writeToStderr(error);
+            writeToStderr("\n");
+            arena_reset(&commandArena);
+            return;
+        }
+        if (parsed.nstages == 0)
+        {
+            return;
+        }
+        if (parsed.heredocs > 0 && !readInputHeredocs(&parsed))
         {
-            write(1, "Bwahaha ... tonight I dine on turtle soup\n", 43);
+            writeToStdout("\n");                                   //^C abandons the whole line
+            lastStatus = 128 + SIGINT;
+            release_parse(&parsed);
+            arena_reset(&commandArena);
+            return;
         }
+
+        lastStatus = runCommand(&commandArena, &parsed);
+        release_parse(&parsed);
+        arena_reset(&commandArena);                                 //releases every token and argv of the line
     }
 }
 
-//-------------------------1B-------------------------/
-/* Signal handler for SIGINT. Catches SIGINT signal (e.g. Ctrl + C) and
- * kills the child process if it exists and is executing. Does not
- * do anything to the parent process and its execution */
-void sigintHandler(int sig)
+/* Expands a !! or !prefix history reference, echoing the result as
+ * bash does, and appends any non-blank line to the history */
+const char *recordHistory(char **line)
 {
-    if (childPid != 0)
+    char *original = *line;
+    const char *error = history_expand(&commandArena, line);
+
+    if (error != NULL)
+    {
+        return error;
+    }
+    if (*line != original)
+    {
+        writeToStdout(*line);
+        writeToStdout("\n");
+    }
+    if ((*line)[strspn(*line, " \t")] != '\0')
     {
-        killChildProcess();
-        executeShell(time);
+        history_add(*line, strlen(*line));
     }
+    return NULL;
 }
 
-/* Registers SIGALRM and SIGINT handlers with corresponding functions.
- * Error checks for signal system call failure and exits program if
- * there is an error */
-void registerSignalHandlers()
+/* Opens $PENN_HISTFILE, or ~/.penn_history. An empty PENN_HISTFILE
+ * keeps no history */
+void openHistory()
 {
-    if (signal(SIGINT, sigintHandler) == SIG_ERR)
+    const char *path = getenv("PENN_HISTFILE");
+    char *defaultPath = NULL;
+
+    if (path == NULL && getenv("HOME") != NULL && asprintf(&defaultPath, "%s/.penn_history", getenv("HOME")) >= 0)
     {
-        perror("Error in signal");
-        exit(EXIT_FAILURE);
+        path = defaultPath;
     }
+    if (path != NULL && *path != '\0' && open_history(path) < 0)
+    {
+        perror(path);
+    }
+    free(defaultPath);
 }
 
-/* Prints the shell prompt and waits for input from user.
- * Takes timeout as an argument and starts an alarm of that timeout period
- * if there is a valid command. It then creates a child process which
- * executes the command with its arguments.
- *
- * The parent process waits for the child. On unsuccessful completion,
- * it exits the shell. */
-void executeShell()
+/* Returns the seconds elapsed between two timespecs */
+static double secondsBetween(struct timespec *start, struct timespec *end)
 {
-    char *command;
-    int status;
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
 
-    char minishell[] = "penn-shredder# ";
-    writeToStdout(minishell);
+/* Prints a duration the way bash's time keyword does */
+static void printTime(const char *label, double seconds)
+{
+    dprintf(STDERR_FILENO, "%s\t%dm%.3fs\n", label, (int)(seconds / 60),
+            seconds - 60 * (int)(seconds / 60));
+}
 
-    command = getCommandFromInput();
-    signal(SIGALRM, alarmHandler);
-    
-    if (command != NULL)
-    {
-        childPid = fork();
+/* Sums the user or system time that the shell and its children
+ * used between two pairs of getrusage samples */
+static double cpuSeconds(struct timeval *selfBefore, struct timeval *selfAfter,
+                         struct timeval *childBefore, struct timeval *childAfter)
+{
+    return (selfAfter->tv_sec - selfBefore->tv_sec) + (childAfter->tv_sec - childBefore->tv_sec)
+         + ((selfAfter->tv_usec - selfBefore->tv_usec) + (childAfter->tv_usec - childBefore->tv_usec)) / 1e6;
+}
+
+/* Subtracts two timevals */
+static struct timeval timevalSince(struct timeval *before, struct timeval *after)
+{
+    struct timeval difference;
+
+    timersub(after, before, &difference);
+    return difference;
+}
+
+/* State of the foreground command between startCommand and finishCommand */
+static struct {
+    JOB *job;                   //processes started by checkPipe that must be waited for
+    STAGE_STATS *stats;         //what each of the job's stages cost, once it is collected
+    int status;                 //exit status of a builtin, already known
+    int timed;                  //1 if the command was prefixed with time
+    const char *builtin;        //name of a builtin run in the shell, logged as a stage of its own
+    const char *text;           //the command line, for the stats log
+    struct timespec start;
+    struct rusage selfBefore, childBefore;
+} current;
+
+/* Logs a builtin that ran inside the shell as a one-stage command
+ * whose cost is what the shell itself used meanwhile */
+static void logBuiltin(struct timespec *end, struct rusage *selfAfter)
+{
+    STAGE_STATS stage;
+
+    memset(&stage, 0, sizeof(stage));
+    stage.pid = getpid();
+    stage.name = (char *)current.builtin;
+    stage.status = current.status;
+    stage.started = current.start;
+    stage.ended = *end;
+    stage.usage.ru_utime = timevalSince(&current.selfBefore.ru_utime, &selfAfter->ru_utime);
+    stage.usage.ru_stime = timevalSince(&current.selfBefore.ru_stime, &selfAfter->ru_stime);
+    stage.usage.ru_maxrss = selfAfter->ru_maxrss;
+    stage.usage.ru_nvcsw = selfAfter->ru_nvcsw - current.selfBefore.ru_nvcsw;
+    stage.usage.ru_nivcsw = selfAfter->ru_nivcsw - current.selfBefore.ru_nivcsw;
+    log_stats(current.text, current.status, &stage, 1);
+}
 
-        if (childPid < 0)
+/* Starts a parsed command without waiting for it. A leading "time"
+ * reports the real, user and system time of everything after it,
+ * then what each stage cost, once finishCommand is called. Command
+ * substitutions are then run and their output put in place of them,
+ * so the arguments are known before anything is launched. A single-stage command naming a
+ * builtin runs to completion inside the shell without forking;
+ * anything else is launched by checkPipe. A command ending in &
+ * is left running as a background job. Anything the command
+ * needs beyond the parsed form is allocated from arena. */
+void startCommand(ARENA *arena, COMMAND *command)
+{
+    STAGE *first = &command->stages[0];
+    COMMAND timedCommand, expandedCommand;
+    const BUILTIN *builtin;
+    const char *error;
+
+    current.job = NULL;
+    current.stats = NULL;
+    current.status = 0;
+    current.timed = 0;
+    current.builtin = NULL;
+    current.text = command->line;
+    trace_begin("command", command->line);
+    clock_gettime(CLOCK_MONOTONIC, &current.start);
+    getrusage(RUSAGE_SELF, &current.selfBefore);
+
+    if (!strcmp(first->argv[0], "time"))
+    {
+        current.timed = 1;
+        getrusage(RUSAGE_CHILDREN, &current.childBefore);
+
+        timedCommand = *command;                    //the parsed command itself is left alone
+        timedCommand.stages = arena_alloc(arena, command->nstages * sizeof(STAGE));
+        memcpy(timedCommand.stages, command->stages, command->nstages * sizeof(STAGE));
+        timedCommand.stages[0].argv++;
+        timedCommand.stages[0].argc--;
+        command = &timedCommand;
+        first = &command->stages[0];
+        if (first->argc == 0 && command->nstages > 1)
         {
-            perror("invalid: Error in creating child process");
-            exit(EXIT_FAILURE);
+            writeToStderr("invalid: missing command\n");      //only a bare "time" may time nothing
+            current.timed = 0;
+            current.status = 1;
+            return;
         }
+    }
 
-        
-        if (childPid == 0)
+    if ((error = expand_command(arena, command, &expandedCommand)) != NULL)
+    {
+        if (*error != '\0')
         {
-            if (checkPipe(command)==0) {
-                checkRedirection(command);
-            }
-            else{
-                exit(EXIT_SUCCESS);
-            }
-                        
+            writeToStderr(error);
+            writeToStderr("\n");
         }
-        else
+        else if (interactive)
         {
+            writeToStdout("\n");                   //as after a foreground job's ^C
+        }
+        current.status = *error != '\0' ? 1 : 128 + SIGINT;
+        return;
+    }
+    command = &expandedCommand;
+    first = &command->stages[0];
 
-            do
+    if (first->argc == 0)
+    {
+        current.status = 0;                         //a bare "time" just reports zero
+    }
+    else if (command->nstages == 1 && !command->background && (builtin = find_builtin(first->argc, first->argv)) != NULL
+             && !builtin->job)
+    {
+        current.builtin = first->argv[0];
+        trace_begin("builtin", first->argv[0]);
+        current.status = runBuiltin(builtin, first);
+        trace_end("builtin");
+    }
+    else
+    {
+        current.job = checkPipe(command, -1);
+        current.stats = arena_alloc(arena, command->nstages * sizeof(STAGE_STATS));
+        if (command->background && current.job->npids > 0)
+        {
+            if (interactive)
             {
-                if (wait(&status) == -1)
-                {
-                    perror("invalid: Error in child process termination");
-                    exit(EXIT_FAILURE);
-                }
-                alarm(0);
-
-            } while (!WIFEXITED(status) && !WIFSIGNALED(status));
-        
-        }
+                dprintf(STDERR_FILENO, "[%d] %d\n", current.job->id, (int)current.job->lastPid);
+            }
+            current.job = NULL;                     //reaped in the background, reported at a later prompt
+        }                                           //nothing started: collected at once like a foreground job
+    }
+}
+
+/* Waits for the command started by startCommand, prints its times
+ * if it was timed and returns its exit status. Jobs are logged to
+ * the stats log when they are removed from the job table; builtins
+ * run in the shell are logged here */
+int finishCommand()
+{
+    struct timespec end;
+    struct rusage selfAfter, childAfter;
+    int nstages = 0;
+
+    if (current.job != NULL)
+    {
+        nstages = current.job->npids;
+        current.status = collect_job(current.job, current.stats);
+        current.job = NULL;
+    }
+
+    if (current.builtin != NULL && get_stats_log() != NULL)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        getrusage(RUSAGE_SELF, &selfAfter);
+        logBuiltin(&end, &selfAfter);
+    }
+    if (current.timed)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        getrusage(RUSAGE_SELF, &selfAfter);
+        getrusage(RUSAGE_CHILDREN, &childAfter);
+        dprintf(STDERR_FILENO, "\n");
+        printTime("real", secondsBetween(&current.start, &end));
+        printTime("user", cpuSeconds(&current.selfBefore.ru_utime, &selfAfter.ru_utime,
+                                     &current.childBefore.ru_utime, &childAfter.ru_utime));
+        printTime("sys", cpuSeconds(&current.selfBefore.ru_stime, &selfAfter.ru_stime,
+                                    &current.childBefore.ru_stime, &childAfter.ru_stime));
+        print_stage_stats(STDERR_FILENO, current.stats, nstages);
+    }
+    trace_end("command");
+    return current.status;
+}
+
+/* Runs a parsed command to completion and returns its exit status */
+int runCommand(ARENA *arena, COMMAND *command)
+{
+    startCommand(arena, command);
+    return finishCommand();
+}
+
+/* Runs a builtin inside the shell. Its redirections are applied by
+ * moving the shell's own standard input and output aside, and put
+ * back once the builtin returns. Returns the builtin's exit status */
+int runBuiltin(const BUILTIN *builtin, STAGE *stage)
+{
+    int inFd = -1, outFd = -1;              //redirection files, if any
+    int savedIn = -1, savedOut = -1;        //the shell's own 0 and 1 while they are replaced
+    LINE_READER *savedInput = shellInput;
+    int redirected;
+    int status;
+
+    trace_begin("redirect", NULL);
+    redirected = checkRedirection(stage, &inFd, &outFd);
+    trace_end("redirect");
+    if (!redirected)
+    {
+        return 1;
+    }
+    if (inFd != -1)
+    {
+        savedIn = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+        dup2(inFd, STDIN_FILENO);
+        close(inFd);
+        shellInput = NULL;                  //what it buffered is not this input
+    }
+    if (outFd != -1)
+    {
+        savedOut = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+        dup2(outFd, STDOUT_FILENO);
+        close(outFd);
+    }
+
+    status = builtin->run(stage->argc, stage->argv);
+
+    if (savedIn != -1)
+    {
+        dup2(savedIn, STDIN_FILENO);
+        close(savedIn);
+        shellInput = savedInput;
+    }
+    if (savedOut != -1)
+    {
+        dup2(savedOut, STDOUT_FILENO);
+        close(savedOut);
     }
+    return status;
 }
 
 /* Writes particular text to standard output */
@@ -167,497 +570,236 @@ void writeToStdout(char *text)
 }
 
 
-/* Checks redirection characters in given command
- * It uses tokenizer program that given by lecturer
- * and holds the tokens in the "args" string arrays
- * If there are invalid commands like multiple inputs
- * or multiple outputs, it returns errors.
- * If there is a valid command, it uses the execvp
- * command to run given command.
- */
-
-void checkRedirection(char *command){
-    
-    TOKENIZER *tokenizer;       //Tokenizer holds tokens from given command
-    char *tok;                  //Tok is for get next token in tokens
-    int fdOut=0,fdIn=0;         //File descriptors to get parsed input and output values from given command
-    
-    int checkChar=0;            //It takes the format of the command (input or output redirections)
-    int largerChar=0;           // 0 if there is no > character in command and 1 if there is no > character in command
-    int smallerChar=0;          // 0 if there is no < character in command and 1 if there is no < character in command
-    
-    tokenizer = init_tokenizer(command);    //initalize the tokenizer
-    
-    while( (tok = get_next_token( tokenizer )) != NULL) {
-
-        if (!strcmp(tok,"<")) {                 //Checks how many redirection character in commands for <
-            smallerChar++;
-        }
-        if (!strcmp(tok,">")) {                 //Checks how many redirection character in commands for >
-            largerChar++;
-        }
-        free( tok );                            //free the token now that we're done with it
-    }
-    if(largerChar==1 && smallerChar==1){
-      //both inut and output redirection
-        checkChar=3;
-    }else if(largerChar>1){
-      //error if there are two output redirection
-        checkChar=-1;
-    }else if(smallerChar>1){
-      //error if there are two input redirection
-        checkChar=-2;
-    }else if(largerChar==1){
-      //output redirection only
-        checkChar=2;
-    }else if(smallerChar==1){
-      //input redirection only
-        checkChar=1;
-    }else{
-        //there is no redirection but valid command to execute
-        checkChar=0;
-    }
-    
-    if (checkChar==1) {
-        
-        char **args=NULL;                       //holds the command that will be called in execvp
-        char **args2=NULL;                      //holds the filename that comes from input redirection
-        int index=0;                            //size of args
-        int index2=0;                           //size of args2
-        
-        tokenizer = init_tokenizer(command);                                        //initalize the tokenizer
-        
-        while( (tok = get_next_token( tokenizer )) != NULL && strcmp(tok,"<")) {    //checks until reaching < character
-            index++;
-            args = (char**)realloc(args, (index+1)*sizeof(*args));                  //reallocation args for next token
-            args[index-1] = (char*)malloc(sizeof(tok));
-            strcpy(args[index-1], tok);
-            free( tok );                                                            //free the token now that we're done with it
-        }
-        
-        while( (tok = get_next_token( tokenizer )) != NULL ) {                      //checks until reaching NULL
-            index2++;
-            args2 = (char**)realloc(args2, (index2+1)*sizeof(*args2));              //reallocation args2 for next token
-            args2[index2-1] = (char*)malloc(sizeof(tok));
-            strcpy(args2[index2-1], tok);
-            free( tok );                                                            //free the token now that we're done with it
-        }
-                
-        if((fdIn = open(args2[0], O_RDONLY , 0644)) < 0){                           //opens input file and assigns file descriptor
-            perror("invalid standard input redirect");
-            exit(EXIT_FAILURE);
-        }
-        
-        dup2(fdIn, 0);                                                              //fdIn is set for standard input
-        close(fdIn);
-         
-        if (execvp(args[0],&args[0])<0) {                                           //Execute the command with our new input fdIn
-            perror("invalid: Wrong arguments for execvp");
-        }
-        
-        free_tokenizer( tokenizer );                                                //free the token now that we're done with it
-        free(args);                                                                 //free the args now that we're done with it
-        free(args2);                                                                //free the args2 now that we're done with it
-        exit(1);
-
-    }
-    
-    else if (checkChar==2) {
-        
-        char **args=NULL;                       //holds the command that will be called in execvp
-        char **args2=NULL;                      //holds the filename that comes from input redirection
-        int index=0;                            //size of args
-        int index2=0;                           //size of args2
-        
-        tokenizer = init_tokenizer(command);                                        //initalize the tokenizer
-        
-        while( (tok = get_next_token( tokenizer )) != NULL && strcmp(tok,">")) {    //checks until reaching > character
-            index++;
-            args = (char**)realloc(args, (index+1)*sizeof(*args));                  //reallocation args for next token
-            args[index-1] = (char*)malloc(sizeof(tok));
-            strcpy(args[index-1], tok);
-            free( tok );                                                            //free the token now that we're done with it
-        }
-        
-        while( (tok = get_next_token( tokenizer )) != NULL ) {                      //checks until reaching NULL
-            index2++;
-            args2 = (char**)realloc(args2, (index2+1)*sizeof(*args2));              //reallocation args2 for next token
-            args2[index2-1] = (char*)malloc(sizeof(tok));
-            strcpy(args2[index2-1], tok);
-            free( tok );                                                            //free the token now that we're done with it
-        }
-                
-        if((fdOut = open(args2[0], O_CREAT | O_WRONLY | O_TRUNC, 0644)) < 0){       //opens output file and assigns file descriptor
-            perror("invalid standard output redirect");                             //it creates if there is no given file, truncates
-                                                                                    //file content and allowed writeng only
-            exit(EXIT_FAILURE);
-        }
-        
-        dup2(fdOut, 1);                                                             //fdOut is set for standard output
-        close(fdOut);
-        
-        if (execvp(args[0],&args[0])<0) {                                           //Execute the command with our new output fdOut
-            perror("invalid: Wrong arguments for execvp");
-        }
-        
-        free_tokenizer( tokenizer );                                                //free the token now that we're done with it
-        free(args);                                                                 //free the args now that we're done with it
-        free(args2);                                                                //free the args2 now that we're done with it
-        exit(1);
-
-    }
-    else if (checkChar==3) {
-        
-        char **args=NULL;                       //holds the command that will be called in execvp
-        char **args2=NULL;                      //holds the filename that comes from input or output redirection
-        char **args3=NULL;                      //holds the filename that comes from input or output redirection
-        
-        char holder[2];                         //checks which "args" is for input and which "args" is for output
-        
-        int index=0;                            //size of args
-        int index2=0;                           //size of args2
-        int index3=0;                           //size of args3
-        
-        tokenizer = init_tokenizer(command);                                        //initalize the tokenizer
-        
-        while( (tok = get_next_token( tokenizer )) != NULL && (  strcmp(tok,"<") && strcmp(tok,">") ) ) {
-                                                                                    //checks until reaching > or < character
-            index++;
-            args = (char**)realloc(args, (index+1)*sizeof(*args));                  //reallocation args for next token
-            args[index-1] = (char*)malloc(sizeof(tok));
-            strcpy(args[index-1], tok);
-                    
-        }
-        
-        if (!strcmp(tok,"<")) {                                                     //checks which character is found
-            holder[0]='<';
-        }
-        else{
-            holder[0]='>';
-        }
-        free( tok );                                                                //free the token now that we're done with it
-
-        
-        while( (tok = get_next_token( tokenizer )) != NULL && ( strcmp(tok,">") && strcmp(tok,"<") ) ) {
-                                                                                    //checks until reaching > or < character
-            index2++;
-            args2 = (char**)realloc(args2, (index2+1)*sizeof(*args2));              //reallocation args2 for next token
-            args2[index2-1] = (char*)malloc(sizeof(tok));
-            strcpy(args2[index2-1], tok);
-        }
-        
-        if (!strcmp(tok,"<")) {                                                     //checks which character is found
-            holder[1]='<';
-        }
-        else{
-            holder[1]='>';
-        }
-        
-        free( tok );                                                                //free the token now that we're done with it
-
-        while( (tok = get_next_token( tokenizer )) != NULL ) {                      //checks until reaching NULL
-            index3++;
-            args3 = (char**)realloc(args3, (index3+1)*sizeof(*args3));              //reallocation args3 for next token
-            args3[index3-1] = (char*)malloc(sizeof(tok));
-            strcpy(args3[index3-1], tok);
-              
-        }
-                        
-        free( tok );                                                                //free the token now that we're done with it
-                
-        if (holder[0]=='<' && holder[1]=='>') {                                     //checks the sides of the redirections
-                
-            if((fdIn = open(args2[0], O_RDONLY , 0644)) < 0){                       //opens input file and assigns file descriptor
-                perror("invalid standard input redirect");
-                exit(EXIT_FAILURE);
-            }
-            
-            if((fdOut = open(args3[0], O_CREAT | O_WRONLY | O_TRUNC, 0644)) < 0){   //opens output file and assigns file descriptor
-                perror("invalid standard output redirect");                         //it creates if there is no given file, truncates
-                exit(EXIT_FAILURE);                                                 //file content and allowed writeng only
-            }
-            
-            dup2(fdOut, 1);                                                         //fdOut is set for standard output
-            close(fdOut);
-            
-            dup2(fdIn, 0);                                                          //fdIn is set for standard input
-            close(fdIn);
-                
-            if (execvp(args[0],&args[0])<0) {                                       //Execute the command with our new output fdOut
-                perror("invalid: Wrong arguments for execvp");                      // and our new input fdIn
+/* Writes particular text to standard error */
+void writeToStderr(const char *text)
+{
+    if (write(STDERR_FILENO, text, strlen(text)) == -1)
+    {
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* One slot of the script queue: a line and its parsed form */
+typedef struct script_slot {
+    ARENA arena;                //owns the line copy and everything parsed from it
+    COMMAND command;
+    const char *error;          //parse error, or NULL
+    int filled;                 //0 once the script has no more lines
+} SCRIPT_SLOT;
+
+/* Takes the << bodies of a script line from the lines after it.
+ * Each body is left where it is in the script text, which outlives
+ * the command, so nothing is copied however large it is */
+static void readScriptHeredocs(COMMAND *command, char **text, char *end)
+{
+    STAGE *stage;
+
+    while ((stage = next_heredoc(command)) != NULL)
+    {
+        size_t delimiterLength = strlen(stage->delimiter);
+        char *body = *text;
+        char *bodyEnd = end;                                    //a missing delimiter ends the body at the end of the script
+
+        while (*text < end)
+        {
+            char *newline = memchr(*text, '\n', end - *text);
+            char *lineEnd = newline != NULL ? newline : end;
+            char *line = *text;
+
+            *text = newline != NULL ? newline + 1 : end;
+            if ((size_t)(lineEnd - line) == delimiterLength && !memcmp(line, stage->delimiter, delimiterLength))
+            {
+                bodyEnd = line;
+                break;
             }
-            
-            free_tokenizer( tokenizer );                                            //free the token now that we're done with it
-            free(args);                                                             //free the args now that we're done with it
-            free(args2);                                                            //free the args2 now that we're done with it
-            free(args3);                                                            //free the args3 now that we're done with it
-            exit(1);
-
-            
         }
-        else if (holder[1]=='<' && holder[0]=='>') {                                //checks the sides of the redirections
-            
-            if((fdIn = open(args3[0], O_RDONLY , 0644)) < 0){                       //opens input file and assigns file descriptor
-                perror("invalid standard input redirect");
-                exit(EXIT_FAILURE);
-            }
-            
-            if((fdOut = open(args2[0], O_CREAT | O_WRONLY | O_TRUNC, 0644)) < 0){   //opens output file and assigns file descriptor
-                perror("invalid standard output redirect");                         //it creates if there is no given file, truncates
-                exit(EXIT_FAILURE);                                                 //file content and allowed writeng only
-            }
-            
-            dup2(fdOut, 1);                                                         //fdOut is set for standard output
-            close(fdOut);
-            
-            dup2(fdIn, 0);                                                          //fdIn is set for standard input
-            close(fdIn);
-            
-            if (execvp(args[0],&args[0])<0) {                                       //Execute the command with our new output fdOut
-                perror("invalid: Wrong arguments for execvp");                      // and our new input fdIn
-            }
-            
-            free_tokenizer( tokenizer );                                            //free the token now that we're done with it
-            free(args);                                                             //free the args now that we're done with it
-            free(args2);                                                            //free the args2 now that we're done with it
-            free(args3);                                                            //free the args3 now that we're done with it
-            exit(1);
+        stage->here = body;
+        stage->hereLength = bodyEnd - body;
+        command->heredocs--;
+    }
+}
 
-        }
-        else{                                                                       //There is a multiple redirection error
-            
-            perror("invalid: Multiple standard redirects or redirect in invalid location");
-            free_tokenizer( tokenizer );                                            //free the token now that we're done with it
-            free(args);                                                             //free the args now that we're done with it
-            free(args2);                                                            //free the args2 now that we're done with it
-            free(args3);                                                            //free the args3 now that we're done with it
-            exit(EXIT_FAILURE);
-        }
-                        
-        exit(1);
-
-    }
-    
-    else if(checkChar==0){                                                          //Execute command without redirection
-        
-        char **args=NULL;                                                           //holds the command that will be called in execvp
-        int index=0;                                                                //size of args
-        
-        tokenizer = init_tokenizer(command);                                        //initalize the tokenizer
-        
-        while( (tok = get_next_token( tokenizer )) != NULL ) {                      //checks until reaching NULL
-            index++;
-            args = (char**)realloc(args, (index+1)*sizeof(*args));                  //reallocation args3 for next token
-            args[index-1] = (char*)malloc(sizeof(tok));
-            strcpy(args[index-1], tok);
-        }
-        free( tok );                                                                //free the args now that we're done with it
-        
-        if (execvp(args[0],&args[0])<0) {                                           //Execute the command
-            perror("invalid: Wrong arguments for execvp");
-        }
-        
-        free_tokenizer( tokenizer );                                                //free the token now that we're done with it
-        free(args);                                                                 //free the args now that we're done with it
-        exit(1);
+/* Copies the next line of the script out of the mapping and parses it
+ * into slot, along with the bodies of any here-documents it has */
+static void parseAhead(SCRIPT_SLOT *slot, char **text, char *end)
+{
+    char *newline;
+    char *line;
+
+    release_parse(&slot->command);                              //its command has finished
+    arena_reset(&slot->arena);
+    slot->filled = *text < end;
+    if (!slot->filled)
+    {
+        return;
     }
-    else if(checkChar==-1){                                                         //Multiple output error
-        perror("invalid: Multiple standard output redirects");
-        exit(EXIT_FAILURE);
+    trace_begin("read", NULL);
+    newline = memchr(*text, '\n', end - *text);
+    if (newline == NULL)
+    {
+        newline = end;                                          //last line without a newline
     }
-    else{                                                                           //Multiple input error
-        perror("invalid: Multiple standard input redirects or redirect in invalid location");
-        exit(EXIT_FAILURE);
+    line = arena_strndup(&slot->arena, *text, newline - *text);
+    *text = newline < end ? newline + 1 : end;
+    trace_end("read");
+    trace_begin("parse", line);
+    slot->error = parse_cached(&slot->arena, line, &slot->command);
+    trace_end("parse");
+    if (slot->error == NULL && slot->command.heredocs > 0)
+    {
+        readScriptHeredocs(&slot->command, text, end);
     }
-    exit(0);
-
 }
 
-int checkPipe(char *command){
-
-    int fd[2];                  //file descriptors
-    pid_t  leftChild,rightChild;//Child processes
-    
-    TOKENIZER *tokenizer;       //Tokenizer holds tokens from given command
-    
-    char *tok;
-    char *cmd1;                 //Left side of the pipeline
-    char *cmd2;                 //Right side of the pipeline
-    
-    int rstatus;                //status of the first child
-
-    int largerChar=0;           // 0 if there is no > character in command and 1 if there is > character in command
-    int smallerChar=0;          // 0 if there is no < character in command and 1 if there is < character in command
-    int pipeChar=0;             // 0 if there is no | character in command and 1 if there is | character in command
-    
-    tokenizer = init_tokenizer(command);    //initalize the tokenizer
-    
-    while( (tok = get_next_token( tokenizer )) != NULL) {
-
-        if (!strcmp(tok,"<")) {                 //Checks how many redirection character in commands for <
-            smallerChar++;
-        }
-        if (!strcmp(tok,">")) {                 //Checks how many redirection character in commands for >
-            largerChar++;
-        }
-        if (!strcmp(tok,"|")) {                 //Checks how many pipe character in commands for |
-            pipeChar++;
-        }
-        free( tok );                            //free the token now that we're done with it
-    }
-
-    if (smallerChar<2 && largerChar<2 && pipeChar<2) {      //if there are invalid commands it returns error
-
-        if (strstr(command,"|")!=NULL) {        //checks for pipe command
-            
-            cmd1=strtok(command,"|");           //splits command for left side and right side
-            cmd2=strtok(NULL,"");
-            
-            
-            if(strstr(&cmd2[1],"<")!=NULL){     //checks if there is invalide pipeline or double input redirection
-                
-                if (strstr(cmd1,">")!=NULL) {
-                    perror("many invalid pieline");
-                    exit(EXIT_FAILURE);
-                }
-                else{
-                    perror("invalid standard input redirect");
-                    exit(EXIT_FAILURE);
-                }
-            }
-            if(strstr(cmd1,">")!=NULL){         //checks if there is invalide pipeline or double output redirection
-                
-                if (strstr(&cmd2[1],"<")!=NULL) {
-                    perror("many invalid pieline");
-                    exit(EXIT_FAILURE);
-                }
-                else{
-                    perror("invalid standard output redirect");
-                    exit(EXIT_FAILURE);
-                }
-            }
-            
-            if((pipe(fd)<0)){                   //if there is no error, it creates a pipe
-                perror("Error creating pipe.\n");
-                exit(EXIT_FAILURE);
-            }
+/* Runs every line of a script held in memory. Parsing runs one
+ * command ahead: once a line's processes are launched, the next
+ * line is parsed while they run, and only then does the shell wait.
+ * Two slots, each with its own arena, hold the queue. */
+void runScript(char *text, size_t length)
+{
+    static SCRIPT_SLOT slots[2];
+    char *end = text + length;
+    int cur = 0;
 
-            if((leftChild=fork())<0){           //forks to run commands splitted before
-                perror("Error forking.\n");
-                exit(EXIT_FAILURE);
-            }
-            
-            //in child process
-            if(leftChild==0){
-
-                dup2(fd[1], 1);                 //Closes other side of pipe and waits for writing
-                close(fd[0]);
-                close(fd[1]);
-                
-                checkRedirection(cmd1);         //Child process executes left side of the pipe
-                
-                
-            }
-            if(leftChild>0){
-                
-                int cstatus;
-                
-                dup2(fd[0], 0);                 //Closes other side of pipe and waits for reading
-                close(fd[1]);
-                close(fd[0]);
-                
-                rightChild = fork();                     //Parent process forks again to execute right side of the pipe
-                
-                if (rightChild < 0)                      //checks for fork creation
-                {
-                    perror("invalid: Error in creating child process");
-                    exit(EXIT_FAILURE);
-                }
-                
-                if (rightChild == 0)
-                {
-                    checkRedirection(&cmd2[1]); //Child process executes right side of the pipe
-                }
-                else
-                {
-                    do
-                    {
-                        if (wait(&cstatus) == -1)       //parent process waits for child process coming from right side of the pipe
-                        {
-                            perror("invalid: Error in child process termination");
-                            exit(EXIT_FAILURE);
-                        }
-                        alarm(0);
-
-                    } while (!WIFEXITED(cstatus) && !WIFSIGNALED(cstatus)); //checks status of the child process
-                    
-                    do
-                    {
-                        if (wait(&rstatus) == -1)       //parent process waits for child process coming from left side of the pipe
-                        {
-                            perror("invalid: Error in child process termination");
-                            exit(EXIT_FAILURE);
-                        }
-                        alarm(0);
-
-                    } while (!WIFEXITED(rstatus) && !WIFSIGNALED(rstatus)); //checks status of the child process
-                    
-                }
-                                
-            }
-            
-            return 1;                                   //if there is a valid pipe, it returns 1
+    init_arena(&slots[0].arena);
+    init_arena(&slots[1].arena);
+
+    parseAhead(&slots[cur], &text, end);
+    while (slots[cur].filled)
+    {
+        SCRIPT_SLOT *slot = &slots[cur];
+
+        if (slot->error != NULL)
+        {
+            writeToStderr(slot->error);
+            writeToStderr("\n");
+            parseAhead(&slots[!cur], &text, end);
         }
-        else{
-            return 0;                                   //if there is a no pipe, it returns 0 and runs command in other function
+        else if (slot->command.nstages == 0)
+        {
+            parseAhead(&slots[!cur], &text, end);
         }
+        else
+        {
+            interrupted = 0;
+            startCommand(&slot->arena, &slot->command);
+            parseAhead(&slots[!cur], &text, end);           //overlaps with the running command
+            lastStatus = finishCommand();
+        }
+        reap_finished_jobs(-1);
+        cur = !cur;
     }
-    
-    else if(pipeChar>=2){                               //if there are multiple pipe commands, returns error
-        perror("invalid pipeline");
-        exit(EXIT_FAILURE);
-    }
-    else if(smallerChar>=2){                            //if there are multiple input redirection commands, returns error
-        perror("invalid input redirection");
-        exit(EXIT_FAILURE);
 
+    release_parse(&slots[0].command);
+    release_parse(&slots[1].command);
+    free_arena(&slots[0].arena);
+    free_arena(&slots[1].arena);
+}
+
+/* Maps a script file into memory and runs it */
+void runScriptFile(const char *path)
+{
+    struct stat st;
+    char *text;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &st) < 0)
+    {
+        perror(path);
+        exit(127);
     }
-    else if(largerChar>=2){                             //if there are multiple output redirection commands, returns error
-        perror("invalid output redirection");
-        exit(EXIT_FAILURE);
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return;
     }
-        
-    perror("invalid pipeline");                         //invalid pipeline
-    exit(EXIT_FAILURE);
-    
-    return 1;
+    text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED)
+    {
+        perror(path);
+        exit(127);
+    }
+    madvise(text, st.st_size, MADV_SEQUENTIAL);
+    runScript(text, st.st_size);
+    munmap(text, st.st_size);
 }
 
 
 
 
-/* Reads input from standard input till it reaches a new line character.
- * Checks if EOF (Ctrl + D) is being read and exits penn-shredder if that is the case
- * Otherwise, it checks for a valid input and adds the characters to an input buffer.
+/* Returns the next line of standard input, without its newline.
+ * Input is read in large blocks through a growable buffer, so lines
+ * of any length work and several lines that arrive in one read are
+ * all kept. The line lives in the reader's buffer until the next
+ * call; nothing is allocated per line.
  *
- * From this input buffer, the first 1023 characters (if more than 1023) or the whole
- * buffer are assigned to command and returned. An \0 is appended to the command so
- * that it is null terminated */
+ * Exits penn-shredder at end of input (Ctrl + D), with the status
+ * of the last command. */
 //-------------------------1A-------------------------/
 char *getCommandFromInput()
 {
-    char *buff = malloc(1024 * sizeof(char));
+    char *line;
 
-    int temp = read(0, buff, 1024);
-    if (temp == 0)
+    trace_begin("read", NULL);
+    line = read_line(&inputReader, NULL);
+    trace_end("read");
+    if (line == NULL)
     {
-        printf("^D\n");
-        exit(0);
+        if (interactive)
+        {
+            writeToStdout("^D\n");
+        }
+        exit(lastStatus);
     }
-    else
+    return line;
+}
+
+/* Reads the << bodies of a command line from standard input, showing
+ * a "> " prompt for each line when interactive. The lines are only
+ * valid until the next read, so the command line is copied first and
+ * each body is gathered and then kept in the command's arena. Returns
+ * 0 if ^C interrupted the reading */
+int readInputHeredocs(COMMAND *command)
+{
+    STAGE *stage;
+    char *body = NULL;
+    size_t capacity = 0;
+
+    command->line = arena_strndup(&commandArena, command->line, strlen(command->line));
+    while ((stage = next_heredoc(command)) != NULL)
     {
-        buff[temp - 1] = '\0';
-    }
+        size_t length = 0, lineLength;
+        char *line;
 
-    return buff;
+        while (1)
+        {
+            if (interactive)
+            {
+                writeToStdout("> ");
+            }
+            if ((line = read_line(&inputReader, &lineLength)) == NULL || !strcmp(line, stage->delimiter))
+            {
+                break;                                          //end of input ends the body too
+            }
+            if (length + lineLength + 1 > capacity)
+            {
+                capacity = (length + lineLength + 1) * 2;
+                body = realloc(body, capacity);
+            }
+            memcpy(body + length, line, lineLength);
+            body[length + lineLength] = '\n';
+            length += lineLength + 1;
+        }
+        if (line == NULL && !inputReader.eof)
+        {
+            free(body);
+            return 0;
+        }
+        stage->here = length > 0 ? arena_strndup(&commandArena, body, length) : "";
+        stage->hereLength = length;
+        command->heredocs--;
+    }
+    free(body);
+    return 1;
 }
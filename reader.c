@@ -0,0 +1,120 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "reader.h"
+
+#define READER_INITIAL_SIZE 65536	/* bytes asked for per read */
+
+
+
+/**
+ * Initializes a line reader.
+ *
+ * @param reader the reader to initialize.  Should be non-NULL.
+ * @param fd the descriptor to read from
+ */
+void init_line_reader( LINE_READER *reader, int fd )
+{
+  reader->fd = fd;
+  reader->buf = NULL;
+  reader->cap = 0;
+  reader->start = 0;
+  reader->end = 0;
+  reader->eof = 0;
+  reader->wait = NULL;
+}
+
+
+
+/* makes room for more input after end, moving the unread bytes to the
+ * front of the buffer or growing it; returns 0 if out of memory */
+static int make_room( LINE_READER *reader )
+{
+  if( reader->start > 0 ) {
+    memmove( reader->buf, reader->buf + reader->start,
+	     reader->end - reader->start );
+    reader->end -= reader->start;
+    reader->start = 0;
+  }
+  if( reader->cap - reader->end < READER_INITIAL_SIZE / 2 ) {
+    size_t cap = reader->cap ? reader->cap * 2 : READER_INITIAL_SIZE;
+    char *buf = (char *)realloc( reader->buf, cap );
+
+    if( buf == NULL )
+      return 0;
+    reader->buf = buf;
+    reader->cap = cap;
+  }
+  return 1;
+}
+
+
+
+/**
+ * Returns the next line without its newline.  The line lives in the
+ * reader's buffer and is only valid until the next call.
+ *
+ * @param reader an initialized reader
+ * @param length if non-NULL, set to the length of the line
+ * @return the null-terminated line, or NULL at end of input
+ */
+char *read_line( LINE_READER *reader, size_t *length )
+{
+  size_t scanned = reader->start;	/* bytes already known to hold no newline */
+  char *line, *newline;
+  ssize_t n;
+
+  for( ;; ) {
+    newline = reader->end > scanned ?
+      memchr( reader->buf + scanned, '\n', reader->end - scanned ) : NULL;
+    if( newline != NULL ) {
+      line = reader->buf + reader->start;
+      *newline = '\0';
+      reader->start = newline + 1 - reader->buf;
+      break;
+    }
+
+    if( reader->eof ) {
+      if( reader->start == reader->end )
+	return NULL;
+      line = reader->buf + reader->start;	/* last line, no newline */
+      reader->buf[reader->end] = '\0';	/* make_room left space for it */
+      reader->start = reader->end;
+      newline = reader->buf + reader->end;
+      break;
+    }
+
+    scanned = reader->end - reader->start;
+    if( !make_room( reader ) )
+      return NULL;
+    if( reader->wait != NULL && !reader->wait( reader->fd ) )
+      return NULL;			/* input is still there for the next call */
+    do {
+      /* always leave a byte for the terminator of an unfinished last line */
+      n = read( reader->fd, reader->buf + reader->end,
+		reader->cap - reader->end - 1 );
+    } while( n < 0 && errno == EINTR );
+    if( n <= 0 )
+      reader->eof = 1;
+    else
+      reader->end += n;
+  }
+
+  if( length != NULL )
+    *length = newline - line;
+  return line;
+}
+
+
+
+/**
+ * Deallocates the reader's buffer.
+ * @param reader an initialized reader
+ */
+void free_line_reader( LINE_READER *reader )
+{
+  free( reader->buf );
+  reader->buf = NULL;
+  reader->cap = reader->start = reader->end = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef __READER_H__
+#define __READER_H__
+
+
+#include <stddef.h>
+
+
+
+/**
+ * Control structure for a buffered line reader.  Reads large blocks
+ * from a descriptor and hands them out one line at a time.
+ */
+typedef struct line_reader {
+  int fd;			/* descriptor being read */
+  char *buf;			/* growable input buffer */
+  size_t cap;			/* size of buf */
+  size_t start;			/* first byte not yet handed out */
+  size_t end;			/* one past the last byte read */
+  int eof;			/* read returned 0 */
+  int (*wait)( int fd );	/* called before each read, or NULL */
+} LINE_READER;
+
+
+
+/**
+ * Initializes a line reader.  Its wait hook starts out NULL; set it
+ * to do other work, such as running the event loop, while the reader
+ * would otherwise block.  The hook returns 0 to give up the read, in
+ * which case read_line returns NULL without reaching end of input.
+ *
+ * @param reader the reader to initialize.  Should be non-NULL.
+ * @param fd the descriptor to read from
+ */
+void init_line_reader( LINE_READER *reader, int fd );
+
+
+
+/**
+ * Returns the next line without its newline.  The line lives in the
+ * reader's buffer and is only valid until the next call; nothing is
+ * allocated per line.  Lines of any length are supported, and a
+ * final line without a newline is still returned.
+ *
+ * @param reader an initialized reader
+ * @param length if non-NULL, set to the length of the line
+ * @return the null-terminated line, or NULL at end of input, on a
+ *         read error or when the wait hook gives up
+ */
+char *read_line( LINE_READER *reader, size_t *length );
+
+
+
+/**
+ * Deallocates the reader's buffer.
+ * @param reader an initialized reader
+ */
+void free_line_reader( LINE_READER *reader );
+
+
+#endif
@@ -0,0 +1,140 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include "stats.h"
+
+static int logFd = -1;          //stats log, opened O_APPEND so each line lands whole
+static char *logPath = NULL;
+
+/* Starts or stops the stats log */
+int set_stats_log(const char *path)
+{
+    int fd = -1;
+
+    if (path != NULL && strcmp(path, "off") != 0
+        && (fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) < 0)
+    {
+        return -1;
+    }
+    if (logFd != -1)
+    {
+        close(logFd);
+    }
+    free(logPath);
+    logFd = fd;
+    logPath = fd != -1 ? strdup(path) : NULL;
+    return 0;
+}
+
+/* Returns the path of the stats log, or NULL */
+const char *get_stats_log(void)
+{
+    return logPath;
+}
+
+/* Seconds between two CLOCK_MONOTONIC samples */
+static double wallSeconds(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static double timevalSeconds(const struct timeval *tv)
+{
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+/* Writes a string as a JSON string literal */
+static void jsonString(FILE *out, const char *text)
+{
+    const unsigned char *c;
+
+    fputc('"', out);
+    for (c = (const unsigned char *)(text != NULL ? text : ""); *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fprintf(out, "\\%c", *c);
+        }
+        else if (*c < 0x20)
+        {
+            fprintf(out, "\\u%04x", *c);
+        }
+        else
+        {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/* Builds the line in memory and writes it with a single write, so
+ * lines from concurrent shells sharing a log never interleave */
+void log_stats(const char *text, int status, const STAGE_STATS *stats, int nstages)
+{
+    struct timespec now, first, last;
+    char *line = NULL;
+    size_t length = 0;
+    FILE *out;
+    int i;
+
+    if (logFd == -1 || (out = open_memstream(&line, &length)) == NULL)
+    {
+        return;
+    }
+    clock_gettime(CLOCK_REALTIME, &now);
+    first = last = nstages > 0 ? stats[0].started : now;
+    for (i = 0; i < nstages; i++)
+    {
+        if (stats[i].started.tv_sec < first.tv_sec
+            || (stats[i].started.tv_sec == first.tv_sec && stats[i].started.tv_nsec < first.tv_nsec))
+        {
+            first = stats[i].started;
+        }
+        if (stats[i].ended.tv_sec > last.tv_sec
+            || (stats[i].ended.tv_sec == last.tv_sec && stats[i].ended.tv_nsec > last.tv_nsec))
+        {
+            last = stats[i].ended;
+        }
+    }
+
+    fprintf(out, "{\"time\":%ld.%06ld,\"command\":", (long)now.tv_sec, now.tv_nsec / 1000);
+    jsonString(out, text);
+    fprintf(out, ",\"status\":%d,\"wall\":%.6f,\"stages\":[", status, wallSeconds(&first, &last));
+    for (i = 0; i < nstages; i++)
+    {
+        const STAGE_STATS *stage = &stats[i];
+
+        fprintf(out, "%s{\"name\":", i > 0 ? "," : "");
+        jsonString(out, stage->name);
+        fprintf(out, ",\"pid\":%d,\"status\":%d,\"wall\":%.6f,\"user\":%.6f,\"sys\":%.6f,"
+                "\"maxrss_kb\":%ld,\"nvcsw\":%ld,\"nivcsw\":%ld}",
+                (int)stage->pid, stage->status, wallSeconds(&stage->started, &stage->ended),
+                timevalSeconds(&stage->usage.ru_utime), timevalSeconds(&stage->usage.ru_stime),
+                stage->usage.ru_maxrss, stage->usage.ru_nvcsw, stage->usage.ru_nivcsw);
+    }
+    fprintf(out, "]}\n");
+    fclose(out);
+
+    write(logFd, line, length);
+    free(line);
+}
+
+/* Prints one line per stage, after time's real/user/sys totals */
+void print_stage_stats(int fd, const STAGE_STATS *stats, int nstages)
+{
+    int i;
+
+    for (i = 0; i < nstages; i++)
+    {
+        const STAGE_STATS *stage = &stats[i];
+
+        dprintf(fd, "[%d] %-12s real %.3fs  user %.3fs  sys %.3fs  maxrss %ldk  csw %ld/%ld  exit %d\n",
+                i, stage->name != NULL ? stage->name : "?", wallSeconds(&stage->started, &stage->ended),
+                timevalSeconds(&stage->usage.ru_utime), timevalSeconds(&stage->usage.ru_stime),
+                stage->usage.ru_maxrss, stage->usage.ru_nvcsw, stage->usage.ru_nivcsw, stage->status);
+    }
+}
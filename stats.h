@@ -0,0 +1,51 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+
+#include "jobs.h"
+
+
+
+/**
+ * Starts appending one JSON line per finished command to a file, or
+ * stops doing so.
+ *
+ * @param path the log file, or NULL or "off" to stop logging
+ * @return 0 on success, -1 with errno set if the file cannot be opened
+ */
+int set_stats_log( const char *path );
+
+
+
+/**
+ * Returns the path of the stats log, or NULL if logging is off.
+ */
+const char *get_stats_log( void );
+
+
+
+/**
+ * Appends a line describing a finished command to the stats log.
+ * Does nothing when logging is off.
+ *
+ * @param text the command line
+ * @param status the command's exit status
+ * @param stats what each stage cost
+ * @param nstages number of entries in stats
+ */
+void log_stats( const char *text, int status, const STAGE_STATS *stats, int nstages );
+
+
+
+/**
+ * Prints one line per stage with its wall time, user and system CPU
+ * time, max RSS and context switches, for the time keyword.
+ *
+ * @param fd where to write
+ * @param stats what each stage cost
+ * @param nstages number of entries in stats
+ */
+void print_stage_stats( int fd, const STAGE_STATS *stats, int nstages );
+
+
+#endif
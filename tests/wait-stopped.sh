@@ -0,0 +1,22 @@
+#!/bin/sh
+# wait with no arguments must skip a stopped background job instead of
+# waiting for it forever, and still wait for the running ones.
+# Usage: tests/wait-stopped.sh ./penn-shredder
+
+shell=${1:-./penn-shredder}
+dir=$(mktemp -d) || exit 1
+trap 'pkill -KILL -f "$dir/stopper"; rm -rf "$dir"' EXIT
+
+printf '#!/bin/sh\nkill -STOP $$\n' > "$dir/stopper"
+chmod +x "$dir/stopper"
+
+output=$(printf '%s/stopper &\nsleep 0.2 &\nwait\necho waited\n' "$dir" \
+         | PENN_HISTFILE= timeout 5 "$shell" 2>&1)
+status=$?
+
+if [ $status -ne 0 ] || [ "${output##*waited}" = "$output" ]; then
+    echo "FAIL wait-stopped: status $status"
+    printf '%s\n' "$output" | head -5
+    exit 1
+fi
+echo "ok   wait-stopped"
@@ -3,8 +3,187 @@
 #include <string.h>
 #include <assert.h>
 #include <ctype.h>
+#include <stdint.h>
 #include "tokenizer.h"
 
+#if defined(__SSE2__) || defined(__x86_64__)
+#include <immintrin.h>
+#define TOKENIZER_X86 1
+#endif
+
+
+
+/*
+ * Word scanning.  A word ends at the first whitespace, delimiter or
+ * \0 character.  The scanners also stop at '$' so that a $( can be
+ * skipped over as part of the word.  Finding the end is where the
+ * tokenizer spends its time on long lines, so it is done by one of
+ * several scanners chosen at runtime.  The vector scanners only ever
+ * load aligned blocks, which never cross a page boundary, so reading
+ * a little past the \0 is safe.
+ */
+typedef const char *(*SCANNER)( const char *p );
+
+static const char *scan_auto( const char *p );
+
+static SCANNER scan_word_end = scan_auto;
+
+/* 1 for every byte that ends a word: \0, | & < > and isspace in the
+   C locale; and $, which may start a substitution */
+static const unsigned char word_stop[256] = {
+  ['\0'] = 1, ['|'] = 1, ['&'] = 1, ['<'] = 1, ['>'] = 1, ['$'] = 1,
+  [' '] = 1, ['\t'] = 1, ['\n'] = 1, ['\v'] = 1, ['\f'] = 1, ['\r'] = 1
+};
+
+
+
+/* one byte at a time via the stop table */
+static const char *scan_scalar( const char *p )
+{
+  while( !word_stop[(unsigned char)*p] )
+    p++;
+  return p;
+}
+
+
+
+#ifdef TOKENIZER_X86
+
+/* lanes of v that hold a word-ending byte */
+static inline __m128i stop_mask_sse2( __m128i v )
+{
+  __m128i t = _mm_sub_epi8( v, _mm_set1_epi8( '\t' ) ); /* \t..\r -> 0..4 */
+  __m128i m = _mm_cmpeq_epi8( _mm_min_epu8( t, _mm_set1_epi8( 4 ) ), t );
+  m = _mm_or_si128( m, _mm_cmpeq_epi8( v, _mm_setzero_si128() ) );
+  m = _mm_or_si128( m, _mm_cmpeq_epi8( v, _mm_set1_epi8( ' ' ) ) );
+  m = _mm_or_si128( m, _mm_cmpeq_epi8( v, _mm_set1_epi8( '|' ) ) );
+  m = _mm_or_si128( m, _mm_cmpeq_epi8( v, _mm_set1_epi8( '&' ) ) );
+  m = _mm_or_si128( m, _mm_cmpeq_epi8( v, _mm_set1_epi8( '<' ) ) );
+  m = _mm_or_si128( m, _mm_cmpeq_epi8( v, _mm_set1_epi8( '>' ) ) );
+  m = _mm_or_si128( m, _mm_cmpeq_epi8( v, _mm_set1_epi8( '$' ) ) );
+  return m;
+}
+
+
+
+/* most words are short, so look at a few bytes before vectorizing */
+#define SCAN_PREFIX 4
+
+
+
+/* 16 bytes at a time */
+__attribute__((target("sse2")))
+static const char *scan_sse2( const char *p )
+{
+  size_t skew;
+  const char *block;
+  unsigned mask;
+  int i;
+
+  for( i = 0; i < SCAN_PREFIX; i++, p++ )
+    if( word_stop[(unsigned char)*p] )
+      return p;
+  skew = (uintptr_t)p & 15;
+  block = p - skew;
+
+  mask = _mm_movemask_epi8( stop_mask_sse2( _mm_load_si128( (const __m128i *)block ) ) );
+  mask &= ~0u << skew;		/* ignore bytes before p */
+  while( mask == 0 ) {
+    block += 16;
+    mask = _mm_movemask_epi8( stop_mask_sse2( _mm_load_si128( (const __m128i *)block ) ) );
+  }
+  return block + __builtin_ctz( mask );
+}
+
+
+
+/* lanes of v that hold a word-ending byte */
+__attribute__((target("avx2")))
+static inline __m256i stop_mask_avx2( __m256i v )
+{
+  __m256i t = _mm256_sub_epi8( v, _mm256_set1_epi8( '\t' ) );
+  __m256i m = _mm256_cmpeq_epi8( _mm256_min_epu8( t, _mm256_set1_epi8( 4 ) ), t );
+  m = _mm256_or_si256( m, _mm256_cmpeq_epi8( v, _mm256_setzero_si256() ) );
+  m = _mm256_or_si256( m, _mm256_cmpeq_epi8( v, _mm256_set1_epi8( ' ' ) ) );
+  m = _mm256_or_si256( m, _mm256_cmpeq_epi8( v, _mm256_set1_epi8( '|' ) ) );
+  m = _mm256_or_si256( m, _mm256_cmpeq_epi8( v, _mm256_set1_epi8( '&' ) ) );
+  m = _mm256_or_si256( m, _mm256_cmpeq_epi8( v, _mm256_set1_epi8( '<' ) ) );
+  m = _mm256_or_si256( m, _mm256_cmpeq_epi8( v, _mm256_set1_epi8( '>' ) ) );
+  m = _mm256_or_si256( m, _mm256_cmpeq_epi8( v, _mm256_set1_epi8( '$' ) ) );
+  return m;
+}
+
+
+
+/* 32 bytes at a time */
+__attribute__((target("avx2")))
+static const char *scan_avx2( const char *p )
+{
+  size_t skew;
+  const char *block;
+  unsigned mask;
+  int i;
+
+  for( i = 0; i < SCAN_PREFIX; i++, p++ )
+    if( word_stop[(unsigned char)*p] )
+      return p;
+  skew = (uintptr_t)p & 31;
+  block = p - skew;
+
+  mask = _mm256_movemask_epi8( stop_mask_avx2( _mm256_load_si256( (const __m256i *)block ) ) );
+  mask &= ~0u << skew;		/* ignore bytes before p */
+  while( mask == 0 ) {
+    block += 32;
+    mask = _mm256_movemask_epi8( stop_mask_avx2( _mm256_load_si256( (const __m256i *)block ) ) );
+  }
+  return block + __builtin_ctz( mask );
+}
+
+#endif
+
+
+
+/**
+ * Selects the routine used to find the end of a word.
+ *
+ * @param name "scalar", "sse2", "avx2", or "auto" for the fastest
+ *             one this CPU supports
+ * @return 1 on success, 0 if the scanner is unknown or unsupported
+ */
+int set_tokenizer_scanner( const char *name )
+{
+  if( !strcmp( name, "scalar" ) ) {
+    scan_word_end = scan_scalar;
+    return 1;
+  }
+#ifdef TOKENIZER_X86
+  __builtin_cpu_init();
+  if( !strcmp( name, "sse2" ) && __builtin_cpu_supports( "sse2" ) ) {
+    scan_word_end = scan_sse2;
+    return 1;
+  }
+  if( !strcmp( name, "avx2" ) && __builtin_cpu_supports( "avx2" ) ) {
+    scan_word_end = scan_avx2;
+    return 1;
+  }
+#endif
+  if( !strcmp( name, "auto" ) ) {
+    if( !set_tokenizer_scanner( "avx2" ) && !set_tokenizer_scanner( "sse2" ) )
+      set_tokenizer_scanner( "scalar" );
+    return 1;
+  }
+  return 0;
+}
+
+
+
+/* picks a scanner on first use, then hands over to it */
+static const char *scan_auto( const char *p )
+{
+  set_tokenizer_scanner( "auto" );
+  return scan_word_end( p );
+}
+
 
 /**
  * Initializes the tokenizer
@@ -44,59 +223,139 @@ void free_tokenizer( TOKENIZER *tokenizer )
 
 
 /**
- * Retrieves the next token in the string.  The returned token is
- * malloc'd in this function, so you should free it when done.
+ * Initializes a caller-owned tokenizer in place.  Nothing is
+ * allocated and the string is not copied.
+ *
+ * @param tokenizer the tokenizer to initialize
+ * @param string the string that will be tokenized.  Should be non-NULL.
+ */
+void init_span_tokenizer( TOKENIZER *tokenizer, char *string )
+{
+  assert( tokenizer != NULL );
+  assert( string != NULL );
+  tokenizer->str = string;
+  tokenizer->pos = string;
+}
+
+
+
+/* returns the token kind for a delimiter character, or TOKEN_WORD */
+static TOKEN_KIND delimiter_kind( char c )
+{
+  switch( c ) {
+  case '|': return TOKEN_PIPE;
+  case '&': return TOKEN_AMP;
+  case '<': return TOKEN_LESS;
+  case '>': return TOKEN_GREATER;
+  default:  return TOKEN_WORD;
+  }
+}
+
+
+
+/**
+ * Finds the end of a command substitution.
+ *
+ * @param p points at the "$(" that opens the substitution
+ * @return one past its closing ")", or NULL if the string ends first
+ */
+char *skip_substitution( const char *p )
+{
+  int depth = 1;
+
+  assert( p[0] == '$' && p[1] == '(' );
+  for( p += 2; *p != '\0'; p++ ) {
+    if( *p == '(' )
+      depth++;
+    else if( *p == ')' && --depth == 0 )
+      return (char *)p + 1;
+  }
+  return NULL;
+}
+
+
+
+/**
+ * Retrieves the next token in the string as a span into the
+ * tokenizer's string.  Does not allocate.
  *
  * @param tokenizer an initiated string tokenizer
- * @return the next token
+ * @param span filled in with the next token on success
+ * @return 1 if a token was found, 0 at the end of the string
  */
-char *get_next_token( TOKENIZER *tokenizer )
+int get_next_span( TOKENIZER *tokenizer, TOKEN_SPAN *span )
 {
   assert( tokenizer != NULL );
+  assert( span != NULL );
   char *startptr = tokenizer->pos;
   char *endptr;
-  char *tok;
+  TOKEN_KIND kind;
 
-  if( *tokenizer->pos == '\0' )	/* handle end-case */
-    return NULL;
+  while( isspace(*startptr) )	/* remove initial white spaces */
+    startptr++;
 
-  
+  if( *startptr == '\0' ) {	/* handle end-case */
+    tokenizer->pos = startptr;
+    return 0;
+  }
 
   /* if current position is a delimiter, then return it */
-  if( (*startptr == '|') || (*startptr == '&') || 
-      (*startptr == '<') || (*startptr == '>') ) {
-    tok = (char *)malloc(2);
-    tok[0] = *startptr;
-    tok[1] = '\0';
-    tokenizer->pos++;
-    return tok;
+  kind = delimiter_kind( *startptr );
+  if( kind != TOKEN_WORD ) {
+    span->offset = startptr - tokenizer->str;
+    span->length = 1;
+    if( kind == TOKEN_LESS && startptr[1] == '<' ) {	/* << or <<< */
+      kind = startptr[2] == '<' ? TOKEN_HERESTRING : TOKEN_HEREDOC;
+      span->length = kind == TOKEN_HERESTRING ? 3 : 2;
+    }
+    span->kind = kind;
+    tokenizer->pos = startptr + span->length;
+    return 1;
   }
 
-  while( isspace(*startptr) )	/* remove initial white spaces */
-    startptr++;
+  /* go until the current character is a delimiter */
+  endptr = (char *)scan_word_end( *startptr == '$' ? startptr : startptr + 1 );
 
-  if( *startptr == '\0' )
-    return NULL;
-
-  /* go until next character is a delimiter */
-  endptr = startptr;
-  for( ;; ) {
-    if( (*(endptr+1) == '|') || (*(endptr+1) == '&') || (*(endptr+1) == '<') ||
-	(*(endptr+1) == '>') || (*(endptr+1) == '\0') || (isspace(*(endptr+1))) ) {
-      tok = (char *)malloc( (endptr - startptr) + 2 );
-      memcpy( tok, startptr, (endptr - startptr) + 1 );
-      tok[(endptr - startptr) + 1] = '\0'; /* null-terminate the string */
-      tokenizer->pos = endptr + 1;
-      while( isspace(*tokenizer->pos) ) /* remove trailing white space */
-	tokenizer->pos++;
-      return tok;
+  /* a $ does not end the word; a $( ... ) keeps its blanks and
+     delimiters inside it */
+  while( *endptr == '$' ) {
+    if( endptr[1] != '(' )
+      endptr = (char *)scan_word_end( endptr + 1 );
+    else if( (endptr = skip_substitution( endptr )) != NULL )
+      endptr = (char *)scan_word_end( endptr );
+    else {
+      endptr = startptr + strlen( startptr );	/* unterminated; the parser reports it */
+      break;
     }
-    endptr++;
   }
-  
-  assert( 0 );			/* should never reach here */
-  return NULL;			/* but satisfy compiler */
+
+  span->offset = startptr - tokenizer->str;
+  span->length = endptr - startptr;
+  span->kind = TOKEN_WORD;
+  tokenizer->pos = endptr;
+  return 1;
 }
 
 
 
+/**
+ * Retrieves the next token in the string.  The returned token is
+ * malloc'd in this function, so you should free it when done.
+ *
+ * @param tokenizer an initiated string tokenizer
+ * @return the next token
+ */
+char *get_next_token( TOKENIZER *tokenizer )
+{
+  TOKEN_SPAN span;
+  char *tok;
+
+  if( !get_next_span( tokenizer, &span ) )
+    return NULL;
+
+  tok = (char *)malloc( span.length + 1 );
+  assert( tok != NULL );
+  memcpy( tok, tokenizer->str + span.offset, span.length );
+  tok[span.length] = '\0';	/* null-terminate the string */
+  return tok;
+}
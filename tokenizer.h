@@ -19,6 +19,33 @@ typedef struct tokenizer {
 
 
 
+/**
+ * Kinds of token a span can describe.
+ */
+typedef enum token_kind {
+  TOKEN_WORD,			/* run of non-delimiter, non-space chars */
+  TOKEN_PIPE,			/* | */
+  TOKEN_AMP,			/* & */
+  TOKEN_LESS,			/* < */
+  TOKEN_GREATER,		/* > */
+  TOKEN_HEREDOC,		/* << */
+  TOKEN_HERESTRING		/* <<< */
+} TOKEN_KIND;
+
+
+
+/**
+ * A token described as a slice of the tokenizer's string rather
+ * than as a copy of it.
+ */
+typedef struct token_span {
+  size_t offset;		/* byte offset of the token in str */
+  size_t length;		/* length of the token in bytes */
+  TOKEN_KIND kind;		/* what the token is */
+} TOKEN_SPAN;
+
+
+
 /**
  * Initializes the tokenizer
  *
@@ -29,6 +56,19 @@ TOKENIZER *init_tokenizer( char *string );
 
 
 
+/**
+ * Initializes a caller-owned tokenizer in place.  Nothing is
+ * allocated and the string is not copied, so it must stay alive and
+ * unmodified for as long as spans are being read from it.  A
+ * tokenizer set up this way must not be passed to free_tokenizer.
+ *
+ * @param tokenizer the tokenizer to initialize
+ * @param string the string that will be tokenized.  Should be non-NULL.
+ */
+void init_span_tokenizer( TOKENIZER *tokenizer, char *string );
+
+
+
 /**
  * Deallocates space used by the tokenizer.
  * @param tokenizer a non-NULL, initialized string tokenizer
@@ -37,6 +77,29 @@ void free_tokenizer( TOKENIZER *tokenizer );
 
 
 
+/**
+ * Retrieves the next token in the string as a span into the
+ * tokenizer's string.  Does not allocate.
+ *
+ * @param tokenizer an initiated string tokenizer
+ * @param span filled in with the next token on success
+ * @return 1 if a token was found, 0 at the end of the string
+ */
+int get_next_span( TOKENIZER *tokenizer, TOKEN_SPAN *span );
+
+
+
+/**
+ * Finds the end of a command substitution.  Parentheses nest, so
+ * substitutions may contain others as well as blanks and delimiters.
+ *
+ * @param p points at the "$(" that opens the substitution
+ * @return one past its closing ")", or NULL if the string ends first
+ */
+char *skip_substitution( const char *p );
+
+
+
 /**
  * Retrieves the next token in the string.  The returned token is
  * malloc'd in this function, so you should free it when done.
@@ -47,4 +110,16 @@ void free_tokenizer( TOKENIZER *tokenizer );
 char *get_next_token( TOKENIZER *tokenizer );
 
 
+
+/**
+ * Selects the routine get_next_span uses to find the end of a word.
+ * By default the fastest one the CPU supports is picked on first
+ * use, so this only needs calling to compare implementations.
+ *
+ * @param name "scalar", "sse2", "avx2", or "auto"
+ * @return 1 on success, 0 if the scanner is unknown or unsupported
+ */
+int set_tokenizer_scanner( const char *name );
+
+
 #endif
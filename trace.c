@@ -0,0 +1,164 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include "trace.h"
+
+#define TRACE_BUFFER (64 * 1024)        //events are written in blocks of about this size
+#define TRACE_EVENT_MAX 1024            //room kept free for one event
+
+static int traceFd = -1;        //-1 while tracing is off, which every entry point checks first
+static pid_t tracePid;
+static char buffer[TRACE_BUFFER];
+static size_t used = 0;
+static int events = 0;
+
+/* Writes out the buffered events */
+static void flushTrace(void)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < used && (n = write(traceFd, buffer + done, used - done)) > 0)
+    {
+        done += n;
+    }
+    used = 0;
+}
+
+/* Closes the JSON array when the shell exits */
+static void finishTrace(void)
+{
+    if (traceFd != -1)
+    {
+        used += snprintf(buffer + used, sizeof(buffer) - used, "\n]\n");
+        flushTrace();
+        close(traceFd);
+        traceFd = -1;
+    }
+}
+
+/* Opens the trace file */
+int init_trace(const char *path)
+{
+    if ((traceFd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+    {
+        return -1;
+    }
+    tracePid = getpid();
+    used = snprintf(buffer, sizeof(buffer), "[");
+    atexit(finishTrace);
+    return 0;
+}
+
+/* Microseconds on CLOCK_MONOTONIC, the unit trace events use */
+static double microseconds(const struct timespec *ts)
+{
+    return ts->tv_sec * 1e6 + ts->tv_nsec / 1e3;
+}
+
+/* Appends text to the buffer as the inside of a JSON string,
+ * truncating it rather than overflowing the room left for the event */
+static void appendEscaped(const char *text, size_t room)
+{
+    const unsigned char *c;
+
+    for (c = (const unsigned char *)text; *c != '\0' && room > 8; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            buffer[used++] = '\\';
+            buffer[used++] = *c;
+            room -= 2;
+        }
+        else if (*c < 0x20)
+        {
+            used += snprintf(buffer + used, 7, "\\u%04x", *c);
+            room -= 6;
+        }
+        else
+        {
+            buffer[used++] = *c;
+            room--;
+        }
+    }
+}
+
+/* Appends one event. tid is the track it is drawn on; dur is only
+ * used by complete ("X") events */
+static void appendEvent(char phase, const char *name, const char *detail,
+                        pid_t tid, double ts, double dur)
+{
+    used += snprintf(buffer + used, sizeof(buffer) - used,
+                     "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+                     events++ > 0 ? "," : "", name, phase, ts, (int)tracePid, (int)tid);
+    if (phase == 'X')
+    {
+        used += snprintf(buffer + used, sizeof(buffer) - used, ",\"dur\":%.3f", dur);
+    }
+    if (detail != NULL)
+    {
+        used += snprintf(buffer + used, sizeof(buffer) - used, ",\"args\":{\"detail\":\"");
+        appendEscaped(detail, TRACE_EVENT_MAX / 2);
+        used += snprintf(buffer + used, sizeof(buffer) - used, "\"}");
+    }
+    used += snprintf(buffer + used, sizeof(buffer) - used, "}");
+    if (sizeof(buffer) - used < TRACE_EVENT_MAX)
+    {
+        flushTrace();
+    }
+}
+
+/* Opens a span on the shell's own track */
+void trace_begin(const char *name, const char *detail)
+{
+    struct timespec now;
+
+    if (traceFd == -1)
+    {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    appendEvent('B', name, detail, tracePid, microseconds(&now), 0);
+}
+
+/* Closes the innermost open span */
+void trace_end(const char *name)
+{
+    struct timespec now;
+
+    if (traceFd == -1)
+    {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    appendEvent('E', name, NULL, tracePid, microseconds(&now), 0);
+}
+
+/* Adds each stage's run as a complete event on a track named after its pid */
+void trace_stages(const STAGE_STATS *stats, int nstages)
+{
+    int i;
+
+    if (traceFd == -1)
+    {
+        return;
+    }
+    for (i = 0; i < nstages; i++)
+    {
+        double start = microseconds(&stats[i].started);
+
+        appendEvent('X', "run", stats[i].name, stats[i].pid, start,
+                    microseconds(&stats[i].ended) - start);
+    }
+}
+
+/* Forgets the inherited trace in a forked child */
+void forget_trace(void)
+{
+    traceFd = -1;
+    used = 0;
+}
@@ -0,0 +1,63 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+
+#include "jobs.h"
+
+
+
+/**
+ * Starts writing a trace of the shell's own work to a file in the
+ * Chrome trace-event format, viewable in chrome://tracing or
+ * Perfetto.  Events are buffered in memory and written in large
+ * blocks, and once more when the shell exits.  Until this is called
+ * every trace function returns straight away.
+ *
+ * @param path the trace file; it is truncated
+ * @return 0 on success, -1 with errno set if it cannot be opened
+ */
+int init_trace( const char *path );
+
+
+
+/**
+ * Opens a span on the shell's timeline.  Spans nest and must be
+ * closed in reverse order.
+ *
+ * @param name the phase, e.g. "parse"; must be a plain literal
+ * @param detail what the phase worked on, or NULL
+ */
+void trace_begin( const char *name, const char *detail );
+
+
+
+/**
+ * Closes the span most recently opened with trace_begin.
+ *
+ * @param name the same name it was opened with
+ */
+void trace_end( const char *name );
+
+
+
+/**
+ * Adds the lifetime of each stage of a finished job, from launch to
+ * reap, as a span on a track of its own, so that the shell's
+ * overhead can be told apart from the time the programs ran.
+ *
+ * @param stats what each stage cost
+ * @param nstages number of entries in stats
+ */
+void trace_stages( const STAGE_STATS *stats, int nstages );
+
+
+
+/**
+ * Drops the trace state inherited by a forked child that keeps
+ * running shell code, so the parent's buffered events are never
+ * written twice.
+ */
+void forget_trace( void );
+
+
+#endif
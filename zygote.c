@@ -0,0 +1,485 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "zygote.h"
+#include "launch.h"
+#include "pathcache.h"
+#include "trace.h"
+
+#define ZYGOTE_MAX_FDS 4        //standard input, standard output, terminal, strings
+#define ZYGOTE_INLINE_MAX (32 * 1024)   //larger string blocks go in a memfd, as messages are bounded by the socket buffer
+
+extern char **environ;
+
+/* What a message to the helper asks for */
+typedef enum zygote_kind {
+    ZYGOTE_LAUNCH,              //strings: path, then argv
+    ZYGOTE_SYNC                 //strings: working directory, then the environment
+} ZYGOTE_KIND;
+
+/* Fixed part of a message; count NUL-terminated strings follow it,
+ * or are in a memfd if hasStrings is set. The descriptors flagged
+ * here travel as SCM_RIGHTS, in this order */
+typedef struct zygote_request {
+    ZYGOTE_KIND kind;
+    pid_t pgid;                 //group for the new process, 0 to lead one
+    int count;                  //number of strings
+    size_t length;              //bytes of strings
+    int hasIn, hasOut, hasTty, hasStrings;
+} ZYGOTE_REQUEST;
+
+/* The helper's answer to ZYGOTE_LAUNCH */
+typedef struct zygote_reply {
+    pid_t pid;                  //-1 if the process could not be created
+    int error;                  //errno when pid is -1
+    int stale;                  //1 if the cached path had gone and PATH was searched again
+} ZYGOTE_REPLY;
+
+static int zygoteSock = -1;     //the shell's end of the socket pair, -1 if not running
+static unsigned generation = 0;         //bumped whenever cwd or environment change
+static unsigned sentGeneration = 0;     //the generation the helper has
+
+/* Puts a block of strings in a memfd. Returns -1 on failure */
+static int stringsFile(const char *strings, size_t length)
+{
+    int fd = memfd_create("penn-zygote", MFD_CLOEXEC);
+    ssize_t n;
+
+    while (fd != -1 && length > 0)
+    {
+        if ((n = write(fd, strings, length)) < 0 && errno != EINTR)
+        {
+            close(fd);
+            return -1;
+        }
+        if (n > 0)
+        {
+            strings += n;
+            length -= n;
+        }
+    }
+    return fd;
+}
+
+/* Sends a message made of a request, a block of strings and up to
+ * three descriptors. A block too big for one message is sent as a
+ * memfd after the other descriptors */
+static int sendRequest(ZYGOTE_REQUEST *request, const char *strings, size_t length, const int *given, int ngiven)
+{
+    char control[CMSG_SPACE(ZYGOTE_MAX_FDS * sizeof(int))];
+    int fds[ZYGOTE_MAX_FDS];
+    int nfds = ngiven;
+    int stringsFd = -1;
+    struct iovec iov[2];
+    struct msghdr msg;
+    int result;
+
+    memcpy(fds, given, ngiven * sizeof(int));
+    request->length = length;
+    request->hasStrings = length > ZYGOTE_INLINE_MAX;
+    if (request->hasStrings)
+    {
+        if ((stringsFd = stringsFile(strings, length)) < 0)
+        {
+            return -1;
+        }
+        fds[nfds++] = stringsFd;
+        length = 0;
+    }
+    iov[0].iov_base = request;
+    iov[0].iov_len = sizeof(*request);
+    iov[1].iov_base = (void *)strings;
+    iov[1].iov_len = length;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    if (nfds > 0)
+    {
+        struct cmsghdr *cmsg;
+
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+    }
+    result = sendmsg(zygoteSock, &msg, MSG_NOSIGNAL) < 0 ? -1 : 0;
+    if (stringsFd != -1)
+    {
+        close(stringsFd);
+    }
+    return result;
+}
+
+/* Reads a block of strings sent as a memfd into a malloc'd buffer */
+static char *readStringsFile(int fd, size_t length)
+{
+    char *block = malloc(length + 1);
+    size_t done = 0;
+    ssize_t n;
+
+    while (block != NULL && done < length)
+    {
+        if ((n = pread(fd, block + done, length - done, done)) <= 0 && !(n < 0 && errno == EINTR))
+        {
+            free(block);
+            return NULL;
+        }
+        if (n > 0)
+        {
+            done += n;
+        }
+    }
+    if (block != NULL)
+    {
+        block[length] = '\0';
+    }
+    return block;
+}
+
+/* Packs count strings one after another into a malloc'd block */
+static char *packStrings(const char *first, char **rest, int *count, size_t *length)
+{
+    size_t size = strlen(first) + 1;
+    char *block, *p;
+    int i;
+
+    for (i = 0; rest[i] != NULL; i++)
+    {
+        size += strlen(rest[i]) + 1;
+    }
+    if ((block = malloc(size)) == NULL)
+    {
+        return NULL;
+    }
+    p = stpcpy(block, first) + 1;
+    for (i = 0; rest[i] != NULL; i++)
+    {
+        p = stpcpy(p, rest[i]) + 1;
+    }
+    *count = i + 1;
+    *length = size;
+    return block;
+}
+
+/* Unpacks the strings of a message into a NULL-terminated array */
+static char **unpackStrings(char *block, size_t length, int count)
+{
+    char **strings = malloc((count + 1) * sizeof(char *));
+    char *p = block;
+    int i;
+
+    if (strings == NULL)
+    {
+        return NULL;
+    }
+    for (i = 0; i < count && p < block + length; i++)
+    {
+        strings[i] = p;
+        p += strlen(p) + 1;
+    }
+    strings[i] = NULL;
+    return strings;
+}
+
+/* Handles one launch request. The process is created with
+ * CLONE_PARENT, which makes it a child of the shell rather than of
+ * the helper, so the shell's SIGCHLD reaping sees it. A raw clone
+ * with no new stack behaves like fork, copying only the helper */
+static void launchRequest(int sock, ZYGOTE_REQUEST *request, char **strings, int *fds)
+{
+    ZYGOTE_REPLY reply = { -1, 0, 0 };
+    int report[2];
+    int error = 0;
+    int k = 0;
+    int inFd = request->hasIn ? fds[k++] : -1;
+    int outFd = request->hasOut ? fds[k++] : -1;
+    int ttyFd = request->hasTty ? fds[k++] : -1;
+
+    if (pipe2(report, O_CLOEXEC) < 0)
+    {
+        report[0] = report[1] = -1;
+    }
+    reply.pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, NULL, NULL, 0);
+    reply.error = errno;
+    if (reply.pid == 0)
+    {
+        enter_stage(inFd, outFd, request->pgid, ttyFd);
+        exec_stage(strings[0], strings + 1, report[1]);
+    }
+    if (report[0] != -1)                                        //the shell drops a cached path the child found missing
+    {
+        close(report[1]);
+        while (reply.pid > 0 && read(report[0], &error, sizeof(error)) < 0 && errno == EINTR)
+        {
+        }
+        reply.stale = error == ENOENT;
+        close(report[0]);
+    }
+    while (k > 0)
+    {
+        close(fds[--k]);
+    }
+    send(sock, &reply, sizeof(reply), MSG_NOSIGNAL);
+}
+
+/* Applies a working directory and environment sent by the shell.
+ * putenv keeps pointers into the message, so the previous one is
+ * only freed once the new environment is in place */
+static void syncRequest(char *block, char **strings)
+{
+    static char *oldBlock = NULL;
+    static char **oldStrings = NULL;
+    int i;
+
+    if (strings[0] != NULL && chdir(strings[0]) < 0)
+    {
+        perror("zygote: chdir");
+    }
+    clearenv();
+    for (i = 1; strings[0] != NULL && strings[i] != NULL; i++)
+    {
+        putenv(strings[i]);
+    }
+    free(oldBlock);
+    free(oldStrings);
+    oldBlock = block;
+    oldStrings = strings;
+}
+
+/* The helper's main loop: one request per message until the shell
+ * closes its end */
+static void runZygote(int sock)
+{
+    char control[CMSG_SPACE(ZYGOTE_MAX_FDS * sizeof(int))];
+    ZYGOTE_REQUEST request;
+
+    setpgid(0, 0);                                              //out of the terminal's way, so ^C never reaches it
+    forget_trace();
+    for (;;)
+    {
+        int fds[ZYGOTE_MAX_FDS];
+        int nfds = 0;
+        struct iovec iov[2];
+        struct msghdr msg;
+        struct cmsghdr *cmsg;
+        ssize_t size = recv(sock, NULL, 0, MSG_PEEK | MSG_TRUNC);
+        char *block, **strings;
+
+        if (size <= 0 || (size_t)size < sizeof(request))
+        {
+            _exit(0);                                           //the shell has gone
+        }
+        if ((block = malloc(size - sizeof(request) + 1)) == NULL)
+        {
+            _exit(1);
+        }
+        iov[0].iov_base = &request;
+        iov[0].iov_len = sizeof(request);
+        iov[1].iov_base = block;
+        iov[1].iov_len = size - sizeof(request);
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) <= 0)
+        {
+            _exit(0);
+        }
+        block[size - sizeof(request)] = '\0';
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            {
+                nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+            }
+        }
+        if (request.hasStrings && nfds > 0)                     //the strings came as the last descriptor
+        {
+            free(block);
+            block = readStringsFile(fds[--nfds], request.length);
+            close(fds[nfds]);
+        }
+        else
+        {
+            request.length = size - sizeof(request);
+        }
+
+        strings = block != NULL ? unpackStrings(block, request.length, request.count) : NULL;
+        if (request.kind == ZYGOTE_SYNC)                        //no reply is expected
+        {
+            if (strings != NULL)
+            {
+                syncRequest(block, strings);                    //keeps block for putenv
+            }
+            else
+            {
+                free(block);
+            }
+            continue;
+        }
+        if (strings != NULL && nfds == request.hasIn + request.hasOut + request.hasTty)
+        {
+            launchRequest(sock, &request, strings, fds);
+        }
+        else
+        {
+            ZYGOTE_REPLY reply = { -1, EINVAL };
+
+            send(sock, &reply, sizeof(reply), MSG_NOSIGNAL);
+        }
+        free(strings);
+        free(block);
+    }
+}
+
+/* Forks the helper with a SOCK_SEQPACKET socket pair to talk over */
+int start_zygote(void)
+{
+    int sv[2];
+    pid_t pid;
+
+    if (zygoteSock != -1)
+    {
+        return 0;
+    }
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+    {
+        return -1;
+    }
+    if ((pid = fork()) < 0)
+    {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        close(sv[0]);
+        runZygote(sv[1]);
+    }
+    close(sv[1]);
+    zygoteSock = sv[0];
+    sentGeneration = generation;                                //it starts with the shell's cwd and environment
+    return 0;
+}
+
+/* Closing the socket makes the helper exit; the shell reaps it */
+void stop_zygote(void)
+{
+    if (zygoteSock != -1)
+    {
+        close(zygoteSock);
+        zygoteSock = -1;
+    }
+}
+
+/* Notes a cd or export, to be sent with the next launch */
+void zygote_environment_changed(void)
+{
+    generation++;
+}
+
+/* Sends the shell's cwd and environment to the helper */
+static int syncZygote(void)
+{
+    ZYGOTE_REQUEST request;
+    char *cwd = getcwd(NULL, 0);
+    char *strings;
+    size_t length;
+    int result;
+
+    memset(&request, 0, sizeof(request));
+    request.kind = ZYGOTE_SYNC;
+    if ((strings = packStrings(cwd != NULL ? cwd : ".", environ, &request.count, &length)) == NULL)
+    {
+        free(cwd);
+        return -1;
+    }
+    result = sendRequest(&request, strings, length, NULL, 0);
+    free(strings);
+    free(cwd);
+    if (result == 0)
+    {
+        sentGeneration = generation;
+    }
+    return result;
+}
+
+/* Asks the helper for a new process and waits for its pid */
+pid_t zygote_launch(STAGE *stage, const char *path, int inFd, int outFd, pid_t pgid, int ttyFd)
+{
+    ZYGOTE_REQUEST request;
+    ZYGOTE_REPLY reply;
+    int fds[ZYGOTE_MAX_FDS];
+    int nfds = 0;
+    char *strings;
+    size_t length;
+    int result;
+
+    if (zygoteSock == -1 && start_zygote() < 0)
+    {
+        return -1;
+    }
+    if (sentGeneration != generation && syncZygote() < 0)
+    {
+        return -1;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.kind = ZYGOTE_LAUNCH;
+    request.pgid = pgid;
+    if ((request.hasIn = inFd != -1))
+    {
+        fds[nfds++] = inFd;
+    }
+    if ((request.hasOut = outFd != -1))
+    {
+        fds[nfds++] = outFd;
+    }
+    if ((request.hasTty = ttyFd != -1))
+    {
+        fds[nfds++] = ttyFd;
+    }
+    if ((strings = packStrings(path, stage->argv, &request.count, &length)) == NULL)
+    {
+        return -1;
+    }
+    result = sendRequest(&request, strings, length, fds, nfds);
+    free(strings);
+    if (result < 0)
+    {
+        return -1;
+    }
+    if (recv(zygoteSock, &reply, sizeof(reply), 0) != sizeof(reply))
+    {
+        errno = EPIPE;                                          //the helper died
+        return -1;
+    }
+    if (reply.pid < 0)
+    {
+        errno = reply.error;
+        return -1;
+    }
+    if (reply.stale)
+    {
+        pathcache_forget(stage->argv[0]);
+    }
+    setpgid(reply.pid, pgid ? pgid : reply.pid);                //it is our child, so this closes the race too
+    return reply.pid;
+}
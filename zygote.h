@@ -0,0 +1,55 @@
+#ifndef __ZYGOTE_H__
+#define __ZYGOTE_H__
+
+
+#include <sys/types.h>
+#include "parser.h"
+
+
+
+/**
+ * Forks the launcher helper, a small copy of the shell that creates
+ * processes on its behalf.  It should be started early, while the
+ * shell is still small, since every launch copies the helper rather
+ * than the shell.  Does nothing if it is already running.
+ *
+ * @return 0 on success, -1 if it could not be started
+ */
+int start_zygote( void );
+
+
+
+/**
+ * Stops the launcher helper, if it is running.
+ */
+void stop_zygote( void );
+
+
+
+/**
+ * Has the launcher helper start one pipeline stage.  The descriptors
+ * are passed to it with SCM_RIGHTS; the new process is created with
+ * CLONE_PARENT, so it is the shell's child and is reaped by the
+ * shell like any other.
+ *
+ * @param stage the stage; only its argv is sent
+ * @param path the program to execute
+ * @param inFd standard input for the stage, or -1 to inherit
+ * @param outFd standard output for the stage, or -1 to inherit
+ * @param pgid process group to join, or 0 to lead a new one
+ * @param ttyFd the terminal to give the group, or -1
+ * @return the pid of the new process, or -1 with errno set
+ */
+pid_t zygote_launch( STAGE *stage, const char *path, int inFd, int outFd,
+		     pid_t pgid, int ttyFd );
+
+
+
+/**
+ * Notes that the shell's working directory or environment has
+ * changed.  The helper is brought up to date before the next launch.
+ */
+void zygote_environment_changed( void );
+
+
+#endif